@@ -0,0 +1,201 @@
+#pragma once
+
+#include"elec.hpp"
+#include<fstream>
+#include<typeinfo>
+
+//功耗模型：每个网络的负载为 (扇出 + 1) 个引脚电容
+struct PowerModel {
+	double PinCapacitance = 2e-15;//法
+	double Voltage = 1.0;         //伏
+	double Frequency = 1e9;       //赫兹，每个周期对应一个时钟
+};
+
+//翻转活动统计：每个周期结束后比较所有单元输出位，值变化或进出高阻都计一次翻转
+//计数放在独立的数组里，不改动 Bit；不创建监视器时线路没有任何额外开销
+//按线路层次汇总，可以输出排序后的报告和 CSV，并按负载电容估计动态功耗
+class ActivityMonitor {
+public:
+	struct Entry {
+		std::string Path;
+		size_t Nets = 0;
+		uint64_t Toggles = 0;
+		double Activity = 0;//每个网络每周期的平均翻转次数
+		double Power = 0;   //动态功耗估计（瓦）
+	};
+
+private:
+	struct Scope {
+		std::string Path;
+		size_t Parent;
+		size_t Depth;
+	};
+
+	circuit& target;
+	std::vector<Scope> scopes;
+	std::vector<const Bit*> nets;
+	std::vector<std::string> netNames;
+	std::vector<size_t> netScope;   //网络所属的叶单元层次
+	std::vector<uint32_t> fanout;
+	std::vector<uint8_t> last;
+	std::vector<uint64_t> toggles;
+	size_t cycles = 0;
+	size_t hook = 0;//线路上附加周期回调的编号
+
+	static uint8_t Load(const Bit* bit) {
+		return bit->isHighZ() ? 2 : uint8_t(bit->isOne());
+	}
+
+	void Walk(Unit* u, size_t parent, size_t index, std::unordered_map<const Bit*, size_t>& seen) {
+		circuit* sub = dynamic_cast<circuit*>(u);
+		std::string name = (sub && !sub->name.empty()) ? sub->name : circuit::TypeName(*u) + "#" + std::to_string(index);
+		size_t scope = scopes.size();
+		scopes.push_back({ scopes[parent].Path + "/" + name, parent, scopes[parent].Depth + 1 });
+		if (sub && sub->IsStructural()) {
+			Visit(*sub, scope, seen);
+			return;
+		}
+		//叶单元：记录它驱动的输出位，组合单元的输出与内部子单元共用同一个位，只记一次
+		for (size_t i = 0; i < u->Outputs.size(); i++) {
+			const Bit* bit = u->Outputs[i].Output;
+			if (seen.count(bit)) continue;
+			seen.emplace(bit, nets.size());
+			nets.push_back(bit);
+			netNames.push_back(scopes[scope].Path + ".out" + std::to_string(i));
+			netScope.push_back(scope);
+		}
+	}
+
+	void Visit(circuit& c, size_t scope, std::unordered_map<const Bit*, size_t>& seen) {
+		size_t index = 0;
+		for (Unit* u : c.comboUnits) Walk(u, scope, index++, seen);
+		for (Unit* u : c.seqUnits) Walk(u, scope, index++, seen);
+	}
+
+	void CountFanout(circuit& c, const std::unordered_map<const Bit*, size_t>& seen) {
+		for (Unit* u : c.comboUnits) CountFanout(u, seen);
+		for (Unit* u : c.seqUnits) CountFanout(u, seen);
+	}
+
+	void CountFanout(Unit* u, const std::unordered_map<const Bit*, size_t>& seen) {
+		circuit* sub = dynamic_cast<circuit*>(u);
+		if (sub && sub->IsStructural()) {
+			CountFanout(*sub, seen);
+			return;
+		}
+		for (auto& node : u->Inputs) {
+			for (const Bit* bit : node.Inputs) {
+				auto it = seen.find(bit);
+				if (it != seen.end()) fanout[it->second]++;
+			}
+		}
+	}
+
+	double Energy(size_t net, const PowerModel& model) const {
+		double c = model.PinCapacitance * double(fanout[net] + 1);
+		return 0.5 * c * model.Voltage * model.Voltage * double(toggles[net]);
+	}
+
+public:
+	//挂到线路上，之后每个周期（Excute/Run/RunUntil）自动计数
+	explicit ActivityMonitor(circuit& c) : target(c) {
+		c.Prepare();
+		scopes.push_back({ c.name.empty() ? "top" : c.name, 0, 0 });
+		std::unordered_map<const Bit*, size_t> seen;
+		Visit(c, 0, seen);
+		fanout.assign(nets.size(), 0);
+		CountFanout(c, seen);
+		toggles.assign(nets.size(), 0);
+		last.resize(nets.size());
+		for (size_t i = 0; i < nets.size(); i++) last[i] = Load(nets[i]);
+		hook = target.AddCycleHook([this](circuit&) { Sample(); });
+	}
+
+	~ActivityMonitor() { target.RemoveCycleHook(hook); }
+
+	ActivityMonitor(const ActivityMonitor&) = delete;
+	ActivityMonitor& operator=(const ActivityMonitor&) = delete;
+
+	//比较一次所有网络，通常由线路在每个周期结束时调用
+	void Sample() {
+		const Bit* const* bit = nets.data();
+		uint8_t* prev = last.data();
+		uint64_t* count = toggles.data();
+		for (size_t i = 0, n = nets.size(); i < n; i++) {
+			uint8_t v = Load(bit[i]);
+			count[i] += v != prev[i];
+			prev[i] = v;
+		}
+		cycles++;
+	}
+
+	void Reset() {
+		std::fill(toggles.begin(), toggles.end(), 0);
+		for (size_t i = 0; i < nets.size(); i++) last[i] = Load(nets[i]);
+		cycles = 0;
+	}
+
+	size_t Cycles() const { return cycles; }
+	size_t NetCount() const { return nets.size(); }
+
+	uint64_t Toggles(const Bit* bit) const {
+		for (size_t i = 0; i < nets.size(); i++) {
+			if (nets[i] == bit) return toggles[i];
+		}
+		throw std::runtime_error("Bit is not monitored");
+	}
+
+	//按层次汇总（perNet 为 true 时列出每个网络），按翻转次数从大到小排序
+	std::vector<Entry> Report(bool perNet = false, const PowerModel& model = {}) const {
+		std::vector<Entry> entries;
+		double seconds = cycles ? double(cycles) / model.Frequency : 0;
+		if (perNet) {
+			for (size_t i = 0; i < nets.size(); i++) {
+				Entry e;
+				e.Path = netNames[i];
+				e.Nets = 1;
+				e.Toggles = toggles[i];
+				e.Power = seconds > 0 ? Energy(i, model) / seconds : 0;
+				entries.push_back(std::move(e));
+			}
+		}
+		else {
+			entries.resize(scopes.size());
+			for (size_t s = 0; s < scopes.size(); s++) entries[s].Path = scopes[s].Path;
+			for (size_t i = 0; i < nets.size(); i++) {
+				double power = seconds > 0 ? Energy(i, model) / seconds : 0;
+				//加到所属单元和所有上层线路
+				for (size_t s = netScope[i];; s = scopes[s].Parent) {
+					entries[s].Nets++;
+					entries[s].Toggles += toggles[i];
+					entries[s].Power += power;
+					if (s == 0) break;
+				}
+			}
+		}
+		for (Entry& e : entries) {
+			e.Activity = (cycles && e.Nets) ? double(e.Toggles) / double(e.Nets) / double(cycles) : 0;
+		}
+		std::stable_sort(entries.begin(), entries.end(),
+			[](const Entry& a, const Entry& b) { return a.Toggles > b.Toggles; });
+		return entries;
+	}
+
+	void Print(size_t top = 20, bool perNet = false, const PowerModel& model = {}) const {
+		std::vector<Entry> entries = Report(perNet, model);
+		std::print("Toggle activity over {} cycles ({} nets)\n", cycles, nets.size());
+		for (size_t i = 0; i < entries.size() && i < top; i++) {
+			const Entry& e = entries[i];
+			std::print("  {:>10} toggles  {:.3f}/net/cycle  {:.3e} W  {}\n", e.Toggles, e.Activity, e.Power, e.Path);
+		}
+	}
+
+	void WriteCsv(const std::string& file, bool perNet = false, const PowerModel& model = {}) const {
+		std::ofstream out(file);
+		if (!out) throw std::runtime_error("Cannot open " + file);
+		out << "path,nets,toggles,activity,power\n";
+		for (const Entry& e : Report(perNet, model)) {
+			out << '"' << e.Path << "\"," << e.Nets << ',' << e.Toggles << ',' << e.Activity << ',' << e.Power << '\n';
+		}
+	}
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include"flat.hpp"
+
+//按层分组的批量求值程序：把 FlatProgram 的指令按依赖分层，每层内同一操作码的门排成一段，
+//输入输出网络编号按操作数分列存放（结构数组），一段用一个循环执行，不再逐门分派
+//分层保持原指令流的读写顺序：读在最后一次写之后，写在此前所有读和写之后，
+//因此同一层内的门互不相关，执行顺序无关紧要，结果与 FlatEngine 逐周期一致
+struct BatchedProgram {
+	struct Segment {
+		uint8_t op;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	std::shared_ptr<const FlatProgram> Flat;
+	std::vector<Segment> Segments;   //按层、层内按操作码排列
+	std::vector<uint32_t> In0;
+	std::vector<uint32_t> In1;
+	std::vector<uint32_t> In2;       //DEC3 第三个输入；LATCH/DFF 的状态槽；OPAQUE/LUT 的下标
+	std::vector<uint32_t> Out;
+	std::vector<uint8_t> Aux;
+	size_t Levels = 0;
+
+	static std::shared_ptr<BatchedProgram> Compile(std::shared_ptr<const FlatProgram> flat) {
+		auto program = std::make_shared<BatchedProgram>();
+		program->Flat = flat;
+		const std::vector<FlatProgram::Instr>& code = flat->Code;
+		//多一个虚拟网络，所有 OPAQUE 都读写它，保持行为级单元之间的原有顺序
+		uint32_t opaqueNet = uint32_t(flat->InitialNets.size());
+		std::vector<uint32_t> writer(opaqueNet + 1, 0);//最后一次写的层号 + 1
+		std::vector<uint32_t> reader(opaqueNet + 1, 0);//此前读过的最大层号 + 1
+		std::vector<uint32_t> level(code.size());
+		std::vector<uint32_t> reads, writes;
+		for (size_t i = 0; i < code.size(); i++) {
+			flat->Operands(code[i], reads, writes);
+			if (code[i].op == FlatProgram::OPAQUE) {
+				reads.push_back(opaqueNet);
+				writes.push_back(opaqueNet);
+			}
+			uint32_t l = 0;
+			for (uint32_t r : reads) l = std::max(l, writer[r]);
+			for (uint32_t w : writes) l = std::max({ l, reader[w], writer[w] });
+			level[i] = l;
+			for (uint32_t r : reads) reader[r] = std::max(reader[r], l + 1);
+			for (uint32_t w : writes) writer[w] = l + 1;
+			program->Levels = std::max<size_t>(program->Levels, l + 1);
+		}
+
+		//按 (层, 操作码) 计数排序，同一段内保持原顺序
+		size_t buckets = program->Levels * FlatProgram::OPCODE_COUNT;
+		std::vector<uint32_t> start(buckets + 1, 0);
+		for (size_t i = 0; i < code.size(); i++) start[level[i] * FlatProgram::OPCODE_COUNT + code[i].op + 1]++;
+		for (size_t b = 0; b < buckets; b++) start[b + 1] += start[b];
+		for (size_t b = 0; b < buckets; b++) {
+			if (start[b] != start[b + 1]) {
+				program->Segments.push_back({ uint8_t(b % FlatProgram::OPCODE_COUNT), start[b], start[b + 1] });
+			}
+		}
+		size_t n = code.size();
+		program->In0.resize(n);
+		program->In1.resize(n);
+		program->In2.resize(n);
+		program->Out.resize(n);
+		program->Aux.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			uint32_t k = start[level[i] * FlatProgram::OPCODE_COUNT + code[i].op]++;
+			program->In0[k] = code[i].in0;
+			program->In1[k] = code[i].in1;
+			program->In2[k] = code[i].in2;
+			program->Out[k] = code[i].out;
+			program->Aux[k] = code[i].aux;
+		}
+		return program;
+	}
+
+	static std::shared_ptr<BatchedProgram> Compile(circuit& c, bool mapLuts = false) {
+		return Compile(FlatProgram::Compile(c, mapLuts));
+	}
+};
+
+//按段执行 BatchedProgram 的引擎，接口与 FlatEngine 相同
+class BatchedEngine {
+private:
+	std::shared_ptr<const BatchedProgram> program;
+	const FlatProgram* flat = nullptr;
+	std::vector<uint8_t> nets;
+	std::vector<uint8_t> q;
+	std::vector<uint8_t> last;
+	size_t cycle = 0;
+
+	void CallOpaque(uint32_t index) {
+		const Netlist::OpaqueUnit& opaque = flat->Opaques[index];
+		for (uint32_t n : opaque.inNets) FlatProgram::Store(flat->NetBits[n], nets[n]);
+		opaque.unit->Do();
+		for (uint32_t n : opaque.outNets) nets[n] = FlatProgram::Load(flat->NetBits[n]);
+	}
+
+public:
+	explicit BatchedEngine(std::shared_ptr<const BatchedProgram> compiled) {
+		Load(std::move(compiled));
+	}
+
+	explicit BatchedEngine(circuit& c, bool mapLuts = false) : BatchedEngine(BatchedProgram::Compile(c, mapLuts)) {}
+
+	//切换到另一个已编译的设计，状态从原始位重新载入
+	void Load(std::shared_ptr<const BatchedProgram> compiled) {
+		program = std::move(compiled);
+		flat = program->Flat.get();
+		nets = flat->InitialNets;
+		q.assign(flat->StateCount, 0);
+		last.assign(flat->StateCount, 0);
+		for (const FlatProgram::Instr& i : flat->Code) {
+			if (i.op == FlatProgram::DFF || i.op == FlatProgram::LATCH) {
+				q[i.in2] = nets[i.out] == 1;
+				if (i.op == FlatProgram::DFF) last[i.in2] = nets[i.in1] == 1;
+			}
+		}
+		cycle = 0;
+	}
+
+	const BatchedProgram& Program() const { return *program; }
+	size_t Cycle() const { return cycle; }
+
+	//执行一个周期：每段一个紧凑循环，循环体无分支，便于编译器向量化
+	void Step() {
+		uint8_t* n = nets.data();
+		uint8_t* state = q.data();
+		uint8_t* clock = last.data();
+		const uint32_t* in0 = program->In0.data();
+		const uint32_t* in1 = program->In1.data();
+		const uint32_t* in2 = program->In2.data();
+		const uint32_t* out = program->Out.data();
+		const uint8_t* aux = program->Aux.data();
+		const Netlist::Lut* luts = flat->Luts.data();
+		for (const BatchedProgram::Segment& s : program->Segments) {
+			uint32_t b = s.begin, e = s.end;
+			switch (s.op) {
+			case FlatProgram::AND:
+				for (uint32_t k = b; k < e; k++) n[out[k]] = (n[in0[k]] == 1) & (n[in1[k]] == 1);
+				break;
+			case FlatProgram::OR:
+			case FlatProgram::RESOLVE:
+				for (uint32_t k = b; k < e; k++) n[out[k]] = (n[in0[k]] == 1) | (n[in1[k]] == 1);
+				break;
+			case FlatProgram::XOR:
+				for (uint32_t k = b; k < e; k++) n[out[k]] = (n[in0[k]] == 1) ^ (n[in1[k]] == 1);
+				break;
+			case FlatProgram::NOT:
+				for (uint32_t k = b; k < e; k++) n[out[k]] = n[in0[k]] != 1;
+				break;
+			case FlatProgram::BUF:
+				for (uint32_t k = b; k < e; k++) n[out[k]] = n[in0[k]] == 1;
+				break;
+			case FlatProgram::CONST1:
+				for (uint32_t k = b; k < e; k++) n[out[k]] = 1;
+				break;
+			case FlatProgram::TRI:
+				//使能为1时输出数据，否则为2（高阻）
+				for (uint32_t k = b; k < e; k++) {
+					uint8_t en = n[in1[k]] == 1;
+					n[out[k]] = uint8_t(en ? (n[in0[k]] == 1) : 2);
+				}
+				break;
+			case FlatProgram::DEC3:
+				for (uint32_t k = b; k < e; k++) {
+					n[out[k]] = ((n[in0[k]] == 1) | ((n[in1[k]] == 1) << 1) | ((n[in2[k]] == 1) << 2)) == aux[k];
+				}
+				break;
+			case FlatProgram::LATCH:
+				for (uint32_t k = b; k < e; k++) {
+					uint8_t& slot = state[in2[k]];
+					uint8_t en = n[in0[k]] == 1;
+					slot = en ? uint8_t(n[in1[k]] == 1) : slot;
+					n[out[k]] = slot;
+				}
+				break;
+			case FlatProgram::DFF:
+				//D 为高阻时按0采样，与 FlatEngine 相同
+				for (uint32_t k = b; k < e; k++) {
+					uint32_t slot = in2[k];
+					uint8_t clk = n[in1[k]] == 1;
+					uint8_t edge = uint8_t(!clock[slot] && clk);
+					state[slot] = edge ? uint8_t(n[in0[k]] == 1) : state[slot];
+					clock[slot] = clk;
+					n[out[k]] = state[slot];
+				}
+				break;
+			case FlatProgram::LUT:
+				for (uint32_t k = b; k < e; k++) n[out[k]] = FlatProgram::LookUp(luts[in2[k]], n);
+				break;
+			case FlatProgram::OPAQUE:
+				for (uint32_t k = b; k < e; k++) CallOpaque(in2[k]);
+				n = nets.data();
+				break;
+			}
+		}
+	}
+
+	//连续执行 cycles 个周期，返回累计周期数
+	size_t Run(size_t cycles) {
+		for (size_t i = 0; i < cycles; i++) {
+			Step();
+		}
+		cycle += cycles;
+		return cycle;
+	}
+
+	//网络值：0/1，-1表示高阻
+	int Value(uint32_t net) const {
+		return nets[net] == 2 ? -1 : nets[net];
+	}
+
+	uint32_t NetOf(const Bit* bit) const {
+		auto it = flat->NetIndex.find(const_cast<Bit*>(bit));
+		if (it == flat->NetIndex.end()) {
+			throw std::runtime_error("Bit is not part of the compiled netlist");
+		}
+		return it->second;
+	}
+
+	//给网络赋值，value 为 -1 表示高阻
+	void Set(uint32_t net, int value) {
+		nets[net] = value == -1 ? 2 : uint8_t(value != 0);
+	}
+
+	void SyncToBits() const {
+		for (uint32_t n = 0; n < nets.size(); n++) {
+			if (flat->NetBits[n]) FlatProgram::Store(flat->NetBits[n], nets[n]);
+		}
+	}
+
+	void SyncFromBits() {
+		for (uint32_t n = 0; n < nets.size(); n++) {
+			if (flat->NetBits[n]) nets[n] = FlatProgram::Load(flat->NetBits[n]);
+		}
+	}
+};
@@ -0,0 +1,330 @@
+#pragma once
+
+#include"lutmap.hpp"
+
+//约简有序二叉决策图（ROBDD）：节点由唯一表去重，同一函数只有一个节点，两个函数等价当且仅当引用相同
+//所有运算归结为 ITE(f,g,h)，结果记在直接映射的计算缓存中；变量编号即层次，编号小的在上
+//不做垃圾回收，一个管理器只用于一次检查；节点数超过 MaxNodes 时抛出异常（例如乘法器这类没有好变量序的函数）
+class BddManager {
+public:
+	using Ref = uint32_t;
+	static constexpr Ref False = 0;
+	static constexpr Ref True = 1;
+
+	size_t MaxNodes;
+
+private:
+	static constexpr uint32_t Terminal = UINT32_MAX;
+
+	struct Node {
+		uint32_t var;
+		Ref lo;
+		Ref hi;
+	};
+
+	struct CacheEntry {
+		Ref f = 0;
+		Ref g = 0;
+		Ref h = 0;
+		Ref result = 0;
+		bool valid = false;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Ref> unique;          //开放寻址，0表示空位（0号是终端节点，不会进表）
+	std::vector<CacheEntry> cache;
+	size_t variables = 0;
+
+	static uint64_t Hash(uint64_t a, uint64_t b, uint64_t c) {
+		uint64_t h = a * 0x9E3779B97F4A7C15ull ^ b * 0xC2B2AE3D27D4EB4Full ^ c * 0x165667B19E3779F9ull;
+		return h ^ (h >> 31);
+	}
+
+	void Grow() {
+		std::vector<Ref> old;
+		old.swap(unique);
+		unique.assign(old.size() * 2, 0);
+		for (Ref r : old) {
+			if (r) Insert(r);
+		}
+	}
+
+	void Insert(Ref r) {
+		size_t mask = unique.size() - 1;
+		size_t i = Hash(nodes[r].var, nodes[r].lo, nodes[r].hi) & mask;
+		while (unique[i]) i = (i + 1) & mask;
+		unique[i] = r;
+	}
+
+	//lo == hi 时节点多余，直接返回子节点
+	Ref Make(uint32_t var, Ref lo, Ref hi) {
+		if (lo == hi) return lo;
+		size_t mask = unique.size() - 1;
+		for (size_t i = Hash(var, lo, hi) & mask; unique[i]; i = (i + 1) & mask) {
+			const Node& n = nodes[unique[i]];
+			if (n.var == var && n.lo == lo && n.hi == hi) return unique[i];
+		}
+		if (nodes.size() >= MaxNodes) throw std::runtime_error("BDD node limit exceeded; try a different variable order");
+		nodes.push_back({ var, lo, hi });
+		Ref r = Ref(nodes.size() - 1);
+		Insert(r);
+		if (nodes.size() * 2 > unique.size()) Grow();
+		return r;
+	}
+
+	uint32_t Top(Ref f) const { return nodes[f].var; }
+
+	Ref Cofactor(Ref f, uint32_t var, bool value) const {
+		if (nodes[f].var != var) return f;
+		return value ? nodes[f].hi : nodes[f].lo;
+	}
+
+public:
+	explicit BddManager(size_t maxNodes = size_t(1) << 24, size_t cacheBits = 20) : MaxNodes(maxNodes) {
+		nodes.push_back({ Terminal, False, False });
+		nodes.push_back({ Terminal, True, True });
+		unique.assign(1024, 0);
+		cache.resize(size_t(1) << cacheBits);
+	}
+
+	//第 index 个变量（即第 index 层）
+	Ref Var(size_t index) {
+		variables = std::max(variables, index + 1);
+		return Make(uint32_t(index), False, True);
+	}
+
+	Ref Ite(Ref f, Ref g, Ref h) {
+		if (f == True) return g;
+		if (f == False) return h;
+		if (g == h) return g;
+		if (g == True && h == False) return f;
+		CacheEntry& e = cache[Hash(f, g, h) & (cache.size() - 1)];
+		if (e.valid && e.f == f && e.g == g && e.h == h) return e.result;
+		uint32_t v = std::min({ Top(f), Top(g), Top(h) });
+		Ref lo = Ite(Cofactor(f, v, false), Cofactor(g, v, false), Cofactor(h, v, false));
+		Ref hi = Ite(Cofactor(f, v, true), Cofactor(g, v, true), Cofactor(h, v, true));
+		Ref r = Make(v, lo, hi);
+		e = { f, g, h, r, true };
+		return r;
+	}
+
+	Ref Not(Ref f) { return Ite(f, False, True); }
+	Ref And(Ref f, Ref g) { return Ite(f, g, False); }
+	Ref Or(Ref f, Ref g) { return Ite(f, True, g); }
+	Ref Xor(Ref f, Ref g) { return Ite(f, Not(g), g); }
+
+	size_t NodeCount() const { return nodes.size(); }
+	size_t Variables() const { return variables; }
+
+	//使 f 为1的一组赋值（按变量编号），不影响结果的变量取0；f 恒为0时返回空
+	std::vector<int> SatisfyingAssignment(Ref f) const {
+		if (f == False) return {};
+		std::vector<int> values(variables, 0);
+		while (f != True) {
+			const Node& n = nodes[f];
+			if (n.lo != False) {
+				f = n.lo;
+			}
+			else {
+				values[n.var] = 1;
+				f = n.hi;
+			}
+		}
+		return values;
+	}
+
+	bool Evaluate(Ref f, const std::vector<int>& values) const {
+		while (f > True) f = values[nodes[f].var] ? nodes[f].hi : nodes[f].lo;
+		return f == True;
+	}
+};
+
+//组合等价性检查：把两个网表的每个输出建成 BDD，逐个比较引用；不等时给出一个反例输入
+//输入、输出按下标一一对应。变量序对 BDD 大小影响很大，加法器一类的数据通路应让两个操作数逐位交错（见 Interleave）
+//只接受纯组合网表：寄存器、锁存器和行为级单元会抛出异常；三态门按读取时的"是否为1"处理，即 en & d
+class EquivalenceChecker {
+public:
+	using Ref = BddManager::Ref;
+	//行为级参考模型：用变量的 BDD 直接写出每个输出
+	using Spec = std::function<std::vector<Ref>(BddManager&, const std::vector<Ref>& inputs)>;
+
+	struct Result {
+		bool Equivalent = false;
+		std::vector<int> Counterexample;    //按输入下标
+		size_t Output = 0;                  //第一个不同的输出
+		int ValueA = 0;
+		int ValueB = 0;
+		size_t Nodes = 0;
+		double Seconds = 0;
+
+		void Print() const {
+			if (Equivalent) {
+				std::print("Equivalent ({} BDD nodes, {:.3f} s)\n", Nodes, Seconds);
+				return;
+			}
+			std::string input;
+			for (size_t i = Counterexample.size(); i-- > 0;) input += char('0' + Counterexample[i]);
+			std::print("Not equivalent: output {} is {} vs {} for input {} (msb first; {} BDD nodes, {:.3f} s)\n",
+				Output, ValueA, ValueB, input, Nodes, Seconds);
+		}
+	};
+
+	size_t MaxNodes = size_t(1) << 24;
+
+	//变量序：先按位交错的各条总线 {起始下标, 宽度}，其余输入按下标排在后面
+	static std::vector<size_t> Interleave(size_t inputs, const std::vector<std::pair<size_t, size_t>>& buses) {
+		std::vector<size_t> order;
+		std::vector<uint8_t> used(inputs, 0);
+		size_t widest = 0;
+		for (auto& bus : buses) widest = std::max(widest, bus.second);
+		for (size_t bit = 0; bit < widest; bit++) {
+			for (auto& [first, width] : buses) {
+				if (bit < width && first + bit < inputs && !used[first + bit]) {
+					order.push_back(first + bit);
+					used[first + bit] = 1;
+				}
+			}
+		}
+		for (size_t i = 0; i < inputs; i++) {
+			if (!used[i]) order.push_back(i);
+		}
+		return order;
+	}
+
+	//逐位加法（含进位输入），返回 n+1 位，供参考模型使用
+	static std::vector<Ref> Add(BddManager& m, const std::vector<Ref>& a, const std::vector<Ref>& b, Ref carry) {
+		std::vector<Ref> sum;
+		for (size_t i = 0; i < a.size(); i++) {
+			Ref half = m.Xor(a[i], b[i]);
+			sum.push_back(m.Xor(half, carry));
+			carry = m.Or(m.And(a[i], b[i]), m.And(half, carry));
+		}
+		sum.push_back(carry);
+		return sum;
+	}
+
+	//按门的顺序符号执行网表，返回各输出的 BDD
+	static std::vector<Ref> Build(BddManager& m, const Netlist& netlist, const std::vector<Ref>& inputs) {
+		using Op = Netlist::Op;
+		std::vector<Ref> value(netlist.NetCount());
+		std::vector<uint8_t> written(netlist.NetCount(), 0), assigned(netlist.NetCount(), 0);
+		for (uint32_t n = 0; n < netlist.NetCount(); n++) value[n] = netlist.InitialValue(n) ? BddManager::True : BddManager::False;
+		for (const Netlist::Gate& g : netlist.Gates) {
+			switch (g.op) {
+			case Op::Latch: case Op::Dff: case Op::Opaque:
+				throw std::runtime_error("Equivalence checking needs a combinational gate-level netlist");
+			default: break;
+			}
+			written[g.out] = 1;
+		}
+		for (size_t i = 0; i < netlist.Inputs.size(); i++) {
+			value[netlist.Inputs[i]] = inputs[i];
+			assigned[netlist.Inputs[i]] = 1;
+		}
+		auto read = [&](uint32_t n) {
+			//读在写之前：有环或未排序，结果取决于上一周期
+			if (written[n] && !assigned[n]) throw std::runtime_error("Netlist reads a net before it is written");
+			return value[n];
+		};
+		for (const Netlist::Gate& g : netlist.Gates) {
+			Ref r = BddManager::False;
+			switch (g.op) {
+			case Op::And: r = m.And(read(g.in[0]), read(g.in[1])); break;
+			case Op::Or:
+			case Op::Resolve: r = m.Or(read(g.in[0]), read(g.in[1])); break;
+			case Op::Xor: r = m.Xor(read(g.in[0]), read(g.in[1])); break;
+			case Op::Not: r = m.Not(read(g.in[0])); break;
+			case Op::Buf: r = read(g.in[0]); break;
+			case Op::Const1: r = BddManager::True; break;
+			case Op::Tri: r = m.And(read(g.in[1]), read(g.in[0])); break;
+			case Op::Dec3: {
+				r = BddManager::True;
+				for (int k = 0; k < 3; k++) {
+					Ref bit = read(g.in[k]);
+					r = m.And(r, ((g.aux >> k) & 1) ? bit : m.Not(bit));
+				}
+				break;
+			}
+			case Op::Lut: {
+				const Netlist::Lut& lut = netlist.Luts[g.in[0]];
+				//按真值表从最高的输入开始做香农展开
+				std::vector<Ref> table(size_t(1) << lut.count);
+				for (size_t k = 0; k < table.size(); k++) table[k] = ((lut.table >> k) & 1) ? BddManager::True : BddManager::False;
+				for (size_t k = 0; k < lut.count; k++) {
+					Ref x = read(lut.in[k]);
+					for (size_t j = 0; j < table.size() / 2; j++) table[j] = m.Ite(x, table[2 * j + 1], table[2 * j]);
+					table.resize(table.size() / 2);
+				}
+				r = table[0];
+				break;
+			}
+			default: break;
+			}
+			value[g.out] = r;
+			assigned[g.out] = 1;
+		}
+		std::vector<Ref> outputs;
+		for (uint32_t n : netlist.Outputs) outputs.push_back(value[n]);
+		return outputs;
+	}
+
+	Result Check(const Netlist& a, const Netlist& b, const std::vector<size_t>& order = {}) const {
+		if (a.Inputs.size() != b.Inputs.size() || a.Outputs.size() != b.Outputs.size()) {
+			throw std::runtime_error("Circuits have different numbers of inputs or outputs");
+		}
+		return Compare(a.Inputs.size(), order,
+			[&](BddManager& m, const std::vector<Ref>& x) { return Build(m, a, x); },
+			[&](BddManager& m, const std::vector<Ref>& x) { return Build(m, b, x); });
+	}
+
+	//两个单元以各自的输入输出为边界比较
+	Result Check(Unit* a, Unit* b, const std::vector<size_t>& order = {}) const {
+		Netlist na(a), nb(b);
+		return Check(na, nb, order);
+	}
+
+	//与参考模型比较，spec 返回的输出个数必须与单元相同
+	Result Check(Unit* impl, const Spec& spec, const std::vector<size_t>& order = {}) const {
+		Netlist netlist(impl);
+		return Compare(netlist.Inputs.size(), order,
+			[&](BddManager& m, const std::vector<Ref>& x) { return Build(m, netlist, x); },
+			[&](BddManager& m, const std::vector<Ref>& x) {
+				std::vector<Ref> out = spec(m, x);
+				if (out.size() != netlist.Outputs.size()) throw std::runtime_error("Spec has a different number of outputs");
+				return out;
+			});
+	}
+
+private:
+	Result Compare(size_t inputs, std::vector<size_t> order, const Spec& left, const Spec& right) const {
+		auto begin = std::chrono::steady_clock::now();
+		if (order.empty()) order = Interleave(inputs, {});
+		if (order.size() != inputs) throw std::runtime_error("Variable order must list every input once");
+		BddManager m(MaxNodes);
+		std::vector<Ref> vars(inputs);
+		std::vector<size_t> level(inputs, SIZE_MAX);
+		for (size_t k = 0; k < inputs; k++) {
+			if (order[k] >= inputs || level[order[k]] != SIZE_MAX) throw std::runtime_error("Variable order must list every input once");
+			level[order[k]] = k;
+		}
+		for (size_t i = 0; i < inputs; i++) vars[i] = m.Var(level[i]);
+		std::vector<Ref> oa = left(m, vars), ob = right(m, vars);
+		Result result;
+		result.Equivalent = true;
+		for (size_t o = 0; o < oa.size(); o++) {
+			if (oa[o] == ob[o]) continue;
+			std::vector<int> byLevel = m.SatisfyingAssignment(m.Xor(oa[o], ob[o]));
+			byLevel.resize(inputs, 0);
+			result.Equivalent = false;
+			result.Output = o;
+			result.Counterexample.assign(inputs, 0);
+			for (size_t i = 0; i < inputs; i++) result.Counterexample[i] = byLevel[level[i]];
+			result.ValueA = m.Evaluate(oa[o], byLevel);
+			result.ValueB = m.Evaluate(ob[o], byLevel);
+			break;
+		}
+		result.Nodes = m.NodeCount();
+		result.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		return result;
+	}
+};
@@ -0,0 +1,247 @@
+#pragma once
+
+#include"flat.hpp"
+#include<cstring>
+
+//状态哈希周期检测：在 FlatEngine 上逐周期哈希全部时序状态，发现重复后按周期长度直接跳到目标周期
+//状态只包括决定下一周期的部分：DFF/锁存器的状态槽和上次时钟、在被写之前就被读取的网络（时钟环、外部输入、三态保持等），
+//纯组合网络每个周期都会重算，不计入。哈希命中后再比较保存的快照，不会因为哈希碰撞误跳
+//哈希按8字节分段求和，每个周期只对和上一个快照相比变化了的段重新计算；快照环随记录的周期数增长，最多 history 个
+//外部输入在 RunTo 期间保持不变，或者由 SetStimulus 按固定周期给出（相位也计入状态）
+//监视的网络（探针）在跳过的周期里按重复段累计翻转次数和为1的周期数；设置 Trace 时逐周期回放记录的值
+//行为级单元（OPAQUE）只允许无内部状态的（IsStateless，如指令存储器），其余的有无法观察的内部状态，不能使用
+class CycleSkipper {
+public:
+	struct Probe {
+		uint32_t Net;
+		uint64_t Toggles = 0;
+		uint64_t Ones = 0;  //值为1的周期数
+		int8_t Last = 0;
+	};
+
+	struct Stats {
+		uint64_t Executed = 0;  //实际执行的周期
+		uint64_t Skipped = 0;   //跳过的周期
+		uint64_t Skips = 0;
+		size_t Period = 0;      //最近一次发现的重复周期
+	};
+
+	//每个周期结束后调用，参数为周期号和探针的值（按 Watch 顺序，-1 为高阻）
+	std::function<void(size_t cycle, const int8_t* values)> Trace;
+
+private:
+	FlatEngine& engine;
+	size_t history;                       //保留最近多少个周期的快照，更长的重复周期检测不到
+	std::vector<uint32_t> stateNets;
+	size_t stateSize;                     //按8字节对齐，末尾补0
+	size_t slots = 0;                     //已分配的快照个数，不超过 history
+	size_t base = 0;                      //周期 base 的快照在环的0号位置
+	std::vector<uint8_t> snapshots;       //slots 个快照，按周期号轮转
+	std::vector<int8_t> probeValues;      //slots 个周期的探针值
+	std::vector<uint8_t> current;         //正在记录的状态
+	bool captured = false;
+	size_t lastIndex = 0;                 //上一个快照在环中的位置
+	uint64_t lastHash = 0;                //上一个快照的哈希
+	std::unordered_map<uint64_t, size_t> seen;//状态哈希 -> 周期号
+	std::vector<Probe> probes;
+	size_t stimulusPeriod = 0;
+	std::function<void(FlatEngine&, size_t)> stimulus;
+	Stats stats;
+
+	//周期在环中的位置，需要时扩大快照环
+	size_t Index(size_t cycle) {
+		size_t index = (cycle - base) % history;
+		if (index >= slots) {
+			slots = std::min(history, std::max(index + 1, 2 * slots));
+			snapshots.resize(slots * stateSize);
+			probeValues.resize(slots * probes.size());
+		}
+		return index;
+	}
+	uint8_t* Slot(size_t cycle) {
+		size_t index = Index(cycle);
+		return snapshots.data() + index * stateSize;
+	}
+	int8_t* ProbeSlot(size_t cycle) {
+		size_t index = Index(cycle);
+		return probeValues.data() + index * probes.size();
+	}
+
+	//第 i 段的值对哈希的贡献（splitmix64）
+	static uint64_t Mix(size_t i, uint64_t w) {
+		uint64_t z = w + (i + 1) * 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	//周期号不再连续时（开始运行、跳过之后），从上一个快照的下一个位置重新编号，旧的快照不再按周期号访问
+	void Rebase() {
+		base = engine.cycle - (captured ? lastIndex + 1 : 0);
+	}
+
+	//把当前状态写入周期 cycle 的快照并返回哈希
+	uint64_t Capture(size_t cycle) {
+		uint8_t* state = current.data();
+		size_t k = 0;
+		for (uint32_t n : stateNets) state[k++] = engine.nets[n];
+		std::memcpy(state + k, engine.q.data(), engine.q.size());
+		k += engine.q.size();
+		std::memcpy(state + k, engine.last.data(), engine.last.size());
+		k += engine.last.size();
+		if (stimulusPeriod) {
+			uint64_t phase = engine.cycle % stimulusPeriod;
+			std::memcpy(state + k, &phase, sizeof(phase));
+		}
+		size_t index = Index(cycle);
+		uint8_t* slot = snapshots.data() + index * stateSize;
+		uint64_t h = 0;
+		if (captured) {
+			//只重算变化的段
+			const uint8_t* previous = snapshots.data() + lastIndex * stateSize;
+			h = lastHash;
+			for (size_t i = 0; i < stateSize; i += 8) {
+				uint64_t w, p;
+				std::memcpy(&w, state + i, 8);
+				std::memcpy(&p, previous + i, 8);
+				if (w != p) h += Mix(i, w) - Mix(i, p);
+			}
+		}
+		else {
+			for (size_t i = 0; i < stateSize; i += 8) {
+				uint64_t w;
+				std::memcpy(&w, state + i, 8);
+				h += Mix(i, w);
+			}
+			captured = true;
+		}
+		std::memcpy(slot, state, stateSize);
+		lastIndex = index;
+		lastHash = h;
+		return h;
+	}
+
+	void Sample() {
+		int8_t* values = ProbeSlot(engine.cycle);
+		for (size_t i = 0; i < probes.size(); i++) {
+			Probe& p = probes[i];
+			int8_t v = int8_t(engine.Value(p.Net));
+			p.Toggles += v != p.Last;
+			p.Ones += v == 1;
+			p.Last = v;
+			values[i] = v;
+		}
+		if (Trace) Trace(engine.cycle, values);
+	}
+
+	//from 与 to 两个周期的状态相同，跳过 repeats 个重复段
+	void Skip(size_t from, size_t to, size_t repeats) {
+		size_t period = to - from;
+		for (size_t i = 0; i < probes.size(); i++) {
+			uint64_t toggles = 0, ones = 0;
+			for (size_t c = from + 1; c <= to; c++) {
+				int8_t v = ProbeSlot(c)[i];
+				toggles += v != ProbeSlot(c - 1)[i];
+				ones += v == 1;
+			}
+			probes[i].Toggles += toggles * repeats;
+			probes[i].Ones += ones * repeats;
+		}
+		if (Trace) {
+			for (size_t j = 0; j < period * repeats; j++) {
+				Trace(to + 1 + j, ProbeSlot(from + 1 + j % period));
+			}
+		}
+		engine.cycle += period * repeats;
+		stats.Skipped += period * repeats;
+		stats.Skips++;
+		stats.Period = period;
+		//周期号整体后移，旧快照的位置不再对应，重新记录
+		seen.clear();
+		Rebase();
+	}
+
+public:
+	explicit CycleSkipper(FlatEngine& e, size_t historyCycles = 1 << 16) : engine(e), history(historyCycles ? historyCycles : 1) {
+		const FlatProgram& program = engine.Program();
+		for (const Netlist::OpaqueUnit& opaque : program.Opaques) {
+			if (!opaque.unit->IsStateless()) {
+				throw std::runtime_error("Cycle skipping needs a gate-level program, " + circuit::TypeName(*opaque.unit) + " may hold internal state");
+			}
+		}
+		//在被写之前读取的网络构成跨周期的状态
+		std::vector<uint8_t> written(program.InitialNets.size(), 0), state(program.InitialNets.size(), 0);
+		std::vector<uint32_t> reads, writes;
+		for (const FlatProgram::Instr& i : program.Code) {
+			program.Operands(i, reads, writes);
+			for (uint32_t r : reads) {
+				if (!written[r] && !state[r]) {
+					state[r] = 1;
+					stateNets.push_back(r);
+				}
+			}
+			for (uint32_t w : writes) written[w] = 1;
+		}
+		stateSize = (stateNets.size() + 2 * program.StateCount + sizeof(uint64_t) + 7) / 8 * 8;
+		current.assign(stateSize, 0);
+	}
+
+	//记录探针，需在第一次 RunTo 之前调用
+	void Watch(uint32_t net) {
+		probes.push_back({ net, 0, 0, int8_t(engine.Value(net)) });
+		probeValues.assign(slots * probes.size(), 0);
+	}
+
+	//周期性激励：每个周期开始前调用 drive(engine, cycle)，激励必须以 period 为周期
+	void SetStimulus(size_t period, std::function<void(FlatEngine&, size_t)> drive) {
+		stimulusPeriod = period;
+		stimulus = std::move(drive);
+		seen.clear();
+	}
+
+	const std::vector<Probe>& Probes() const { return probes; }
+	const Stats& Statistics() const { return stats; }
+
+	//执行到第 target 个周期，返回实际执行的周期数
+	size_t RunTo(size_t target) {
+		size_t executed = 0;
+		seen.clear();
+		if (engine.cycle < target) {
+			//起点状态也记录下来，第一个周期就回到起点时可以识别
+			Rebase();
+			seen[Capture(engine.cycle)] = engine.cycle;
+			int8_t* values = ProbeSlot(engine.cycle);
+			for (size_t i = 0; i < probes.size(); i++) values[i] = probes[i].Last;
+		}
+		while (engine.cycle < target) {
+			if (stimulus) stimulus(engine, engine.cycle);
+			engine.Step();
+			engine.cycle++;
+			executed++;
+			Sample();
+			uint64_t h = Capture(engine.cycle);
+			auto it = seen.find(h);
+			if (it != seen.end() && engine.cycle - it->second < history
+				&& std::memcmp(Slot(it->second), Slot(engine.cycle), stateSize) == 0) {
+				size_t from = it->second, to = engine.cycle;
+				size_t repeats = (target - to) / (to - from);
+				if (repeats > 0) {
+					Skip(from, to, repeats);
+					seen[Capture(engine.cycle)] = engine.cycle;
+					int8_t* values = ProbeSlot(engine.cycle);
+					for (size_t i = 0; i < probes.size(); i++) values[i] = probes[i].Last;
+					continue;
+				}
+			}
+			seen[h] = engine.cycle;
+			//过期的哈希不再有快照对应，定期清理
+			if (seen.size() > 4 * history) {
+				for (auto e = seen.begin(); e != seen.end();) {
+					e = engine.cycle - e->second >= history ? seen.erase(e) : std::next(e);
+				}
+			}
+		}
+		stats.Executed += executed;
+		return executed;
+	}
+};
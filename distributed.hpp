@@ -0,0 +1,476 @@
+#pragma once
+
+#include"flat.hpp"
+#include<atomic>
+#include<cstring>
+#include<map>
+
+//多进程分区仿真：按子线路把展开后的设计分成若干分区，每个分区由一个本机进程执行
+//各进程按同一个构建函数重新构建设计（网络编号因此一致），只执行属于自己分区的指令
+//分区之间的边界网络每周期通过共享内存中的单生产者单消费者环形通道交换，不加锁
+//同步是保守的：读在写之后的网络（同一周期）要等对方这个周期结束；读在写之前的网络用对方上个周期的值
+//同一周期的依赖在分区之间不能成环，否则构造时抛出异常；应在寄存器处切分
+//目前用同一台机器的多个进程代替集群节点，通道换成网络连接即可跨机器
+
+//构建函数返回的设计：Parts 中每个子线路（例如每个 ALU 实例）一个分区，其余部分归0号分区（父进程）
+struct PartitionedDesign {
+	circuit* Root = nullptr;
+	std::vector<Unit*> Parts;
+};
+
+class DistributedSimulation {
+public:
+	using Builder = std::function<PartitionedDesign()>;
+
+	struct PartitionStats {
+		size_t Instructions = 0;
+		size_t Received = 0;        //每周期接收的边界网络数
+		size_t Sent = 0;
+		double BusySeconds = 0;
+		double StallSeconds = 0;    //等待通道的时间
+	};
+
+	struct Report {
+		size_t Cycles = 0;
+		double Seconds = 0;
+		size_t Channels = 0;
+		std::vector<PartitionStats> Partitions;
+
+		void Print() const {
+			std::print("Distributed: {} partitions, {} channels, {} cycles in {:.3f} s ({:.0f} cycles/s)\n",
+				Partitions.size(), Channels, Cycles, Seconds, Seconds > 0 ? Cycles / Seconds : 0.0);
+			for (size_t p = 0; p < Partitions.size(); p++) {
+				const PartitionStats& s = Partitions[p];
+				std::print("  partition {}: {} instrs, in {} / out {} nets, busy {:.3f} s, stall {:.3f} s\n",
+					p, s.Instructions, s.Received, s.Sent, s.BusySeconds, s.StallSeconds);
+			}
+		}
+	};
+
+	//设计按名字登记，父进程和分区进程各自调用同一个构建函数
+	static void Register(const std::string& name, Builder builder) {
+		Designs()[name] = std::move(builder);
+	}
+
+private:
+	static constexpr uint32_t MagicValue = 0x54534944;//"DIST"
+	static constexpr size_t RingSlots = 64;
+
+	struct Header {
+		uint32_t Magic;
+		uint32_t Partitions;
+		uint64_t Cycles;
+		uint64_t NetCount;
+		std::atomic<uint32_t> Abort;    //任一进程出错后置1，其余进程不再等待
+	};
+
+	struct alignas(64) Status {
+		std::atomic<uint64_t> Cycle;
+		std::atomic<uint32_t> Done;
+		double BusySeconds;
+		double StallSeconds;
+	};
+
+	//读写计数分开放在两个缓存行，生产者只写 Head，消费者只写 Tail
+	struct Ring {
+		alignas(64) std::atomic<uint64_t> Head;
+		alignas(64) std::atomic<uint64_t> Tail;
+	};
+
+	//From 每周期结束后把 Nets 的值（0/1/2）作为一条消息发给 To
+	struct Channel {
+		uint32_t From;
+		uint32_t To;
+		std::vector<uint32_t> Nets;
+		std::vector<uint8_t> SameCycle;  //1：To 在 From 写之后读取，要等 From 的同一周期
+		bool Waits = false;              //含同一周期的网络
+		size_t Offset = 0;
+		size_t SlotBytes = 0;
+	};
+
+	std::string design;
+	std::string mappingName;
+	uint32_t self;
+	PartitionedDesign built;
+	std::shared_ptr<const FlatProgram> program;  //本分区的指令子集，网络编号与整体相同
+	std::vector<std::vector<uint32_t>> owned;    //每个分区写的网络
+	std::vector<size_t> instructions;
+	std::vector<Channel> channels;
+	size_t statusOffset = 0;
+	size_t snapshotOffset = 0;
+	size_t bytes = 0;
+	HANDLE mapping = nullptr;
+	uint8_t* base = nullptr;
+	std::unique_ptr<FlatEngine> engine;
+	std::vector<PROCESS_INFORMATION> processes;  //父进程启动的分区进程
+	Report report;
+	bool ran = false;
+
+	static std::map<std::string, Builder>& Designs() {
+		static std::map<std::string, Builder> designs;
+		return designs;
+	}
+
+	static size_t Align(size_t n) { return (n + 63) / 64 * 64; }
+
+	Header* Head() const { return reinterpret_cast<Header*>(base); }
+	Status* StatusOf(size_t p) const { return reinterpret_cast<Status*>(base + statusOffset) + p; }
+	Ring* RingOf(const Channel& ch) const { return reinterpret_cast<Ring*>(base + ch.Offset); }
+	uint8_t* Slot(const Channel& ch, uint64_t index) const {
+		return base + ch.Offset + sizeof(Ring) + (index % RingSlots) * ch.SlotBytes;
+	}
+
+	//子线路及其所有子单元归入分区 p
+	static void Mark(Unit* u, uint32_t p, std::unordered_map<const Unit*, uint32_t>& partOf) {
+		if (!partOf.emplace(u, p).second) {
+			throw std::runtime_error("A unit belongs to more than one partition");
+		}
+		if (circuit* sub = dynamic_cast<circuit*>(u)) {
+			for (Unit* v : sub->comboUnits) Mark(v, p, partOf);
+			for (Unit* v : sub->seqUnits) Mark(v, p, partOf);
+		}
+	}
+
+	//构建设计，按来源单元给每条指令分区，找出跨分区读取的网络；各进程结果相同
+	void Plan() {
+		auto it = Designs().find(design);
+		if (it == Designs().end()) throw std::runtime_error("Unknown distributed design " + design);
+		built = it->second();
+		Netlist netlist(*built.Root);
+		std::shared_ptr<FlatProgram> whole = FlatProgram::Compile(netlist);
+		const uint32_t partitions = uint32_t(built.Parts.size() + 1);
+		if (self >= partitions) throw std::out_of_range("Partition index out of range");
+
+		std::unordered_map<const Unit*, uint32_t> partOf;
+		for (uint32_t p = 1; p < partitions; p++) Mark(built.Parts[p - 1], p, partOf);
+		const std::vector<FlatProgram::Instr>& code = whole->Code;
+		std::vector<uint32_t> part(code.size(), 0);
+		for (size_t i = 0; i < code.size(); i++) {
+			auto found = partOf.find(netlist.Gates[i].unit);
+			if (found != partOf.end()) part[i] = found->second;
+		}
+
+		//每个网络只能由一个分区写，记下第一次和最后一次写的位置
+		const size_t nets = whole->InitialNets.size();
+		const uint32_t none = UINT32_MAX;
+		std::vector<uint32_t> writer(nets, none);
+		std::vector<size_t> firstWrite(nets, 0), lastWrite(nets, 0);
+		std::vector<uint32_t> reads, writes;
+		owned.assign(partitions, {});
+		instructions.assign(partitions, 0);
+		for (size_t i = 0; i < code.size(); i++) {
+			instructions[part[i]]++;
+			whole->Operands(code[i], reads, writes);
+			for (uint32_t w : writes) {
+				if (writer[w] == none) {
+					writer[w] = part[i];
+					firstWrite[w] = i;
+					owned[part[i]].push_back(w);
+				}
+				else if (writer[w] != part[i]) {
+					throw std::runtime_error("A net is written by more than one partition");
+				}
+				lastWrite[w] = i;
+			}
+		}
+
+		//跨分区读取：全部在对方最后一次写之后为同一周期，全部在第一次写之前为上一周期，交错的无法按周期交换
+		std::map<std::pair<uint32_t, uint32_t>, std::map<uint32_t, uint8_t>> crossing;
+		for (size_t i = 0; i < code.size(); i++) {
+			whole->Operands(code[i], reads, writes);
+			for (uint32_t r : reads) {
+				uint32_t w = writer[r];
+				if (w == none || w == part[i]) continue;
+				uint8_t same;
+				if (i > lastWrite[r]) same = 1;
+				else if (i < firstWrite[r]) same = 0;
+				else throw std::runtime_error("A boundary net is read between writes of another partition");
+				auto [entry, inserted] = crossing[{ w, part[i] }].emplace(r, same);
+				if (!inserted && entry->second != same) {
+					throw std::runtime_error("A boundary net is read both before and after it is written");
+				}
+			}
+		}
+
+		//同一周期的依赖不能成环
+		std::vector<std::vector<uint32_t>> waitsOn(partitions);
+		std::vector<size_t> indegree(partitions, 0);
+		for (auto& [key, list] : crossing) {
+			Channel ch;
+			ch.From = key.first;
+			ch.To = key.second;
+			for (auto& [net, same] : list) {
+				ch.Nets.push_back(net);
+				ch.SameCycle.push_back(same);
+				ch.Waits |= same != 0;
+			}
+			ch.SlotBytes = (ch.Nets.size() + 7) / 8 * 8;
+			if (ch.Waits) {
+				waitsOn[ch.From].push_back(ch.To);
+				indegree[ch.To]++;
+			}
+			channels.push_back(std::move(ch));
+		}
+		std::vector<uint32_t> ready;
+		for (uint32_t p = 0; p < partitions; p++) {
+			if (indegree[p] == 0) ready.push_back(p);
+		}
+		size_t ordered = 0;
+		while (!ready.empty()) {
+			uint32_t p = ready.back();
+			ready.pop_back();
+			ordered++;
+			for (uint32_t q : waitsOn[p]) {
+				if (--indegree[q] == 0) ready.push_back(q);
+			}
+		}
+		if (ordered != partitions) {
+			throw std::runtime_error("Partitions depend on each other within a cycle; cut the design at registers");
+		}
+
+		//共享内存布局：头、每个分区的状态、各通道、最终网络值
+		statusOffset = Align(sizeof(Header));
+		size_t offset = statusOffset + Align(sizeof(Status) * partitions);
+		for (Channel& ch : channels) {
+			ch.Offset = offset;
+			offset += Align(sizeof(Ring) + RingSlots * ch.SlotBytes);
+		}
+		snapshotOffset = offset;
+		bytes = Align(offset + nets);
+
+		std::shared_ptr<FlatProgram> mine = std::make_shared<FlatProgram>(*whole);
+		mine->Code.clear();
+		for (size_t i = 0; i < code.size(); i++) {
+			if (part[i] == self) mine->Code.push_back(code[i]);
+		}
+		program = mine;
+	}
+
+	void Map(bool create) {
+		std::string name = "Local\\" + mappingName;
+		mapping = create
+			? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(uint64_t(bytes) >> 32), DWORD(bytes), name.c_str())
+			: OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+		if (!mapping) throw std::runtime_error("Cannot open shared memory " + mappingName);
+		base = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes));
+		if (!base) {
+			CloseHandle(mapping);
+			mapping = nullptr;
+			throw std::runtime_error("Cannot map shared memory " + mappingName);
+		}
+	}
+
+	//分区进程在完成之前退出（例如构建设计时出错，来不及通知其他进程）
+	bool ProcessLost() const {
+		for (size_t k = 0; k < processes.size(); k++) {
+			if (WaitForSingleObject(processes[k].hProcess, 0) == WAIT_OBJECT_0
+				&& !StatusOf(k + 1)->Done.load(std::memory_order_acquire)) return true;
+		}
+		return false;
+	}
+
+	//等待条件成立，先自旋再让出时间片；有进程出错时抛出异常
+	template<class F> void Wait(F ready, double& stall) {
+		if (ready()) return;
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned spin = 0; !ready(); spin++) {
+			if (Head()->Abort.load(std::memory_order_acquire) || (spin % 4096 == 4095 && ProcessLost())) {
+				throw std::runtime_error("Another partition failed");
+			}
+			if (spin > 64) std::this_thread::yield();
+		}
+		stall += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void Push(const Channel& ch, double& stall) {
+		Ring* ring = RingOf(ch);
+		uint64_t head = ring->Head.load(std::memory_order_relaxed);
+		Wait([&] { return head - ring->Tail.load(std::memory_order_acquire) < RingSlots; }, stall);
+		uint8_t* slot = Slot(ch, head);
+		for (size_t j = 0; j < ch.Nets.size(); j++) {
+			int v = engine->Value(ch.Nets[j]);
+			slot[j] = v == -1 ? 2 : uint8_t(v);
+		}
+		ring->Head.store(head + 1, std::memory_order_release);
+	}
+
+	void Pop(const Channel& ch, std::vector<uint8_t>& out, double& stall) {
+		Ring* ring = RingOf(ch);
+		uint64_t tail = ring->Tail.load(std::memory_order_relaxed);
+		Wait([&] { return ring->Head.load(std::memory_order_acquire) != tail; }, stall);
+		out.assign(Slot(ch, tail), Slot(ch, tail) + ch.Nets.size());
+		ring->Tail.store(tail + 1, std::memory_order_release);
+	}
+
+	void Apply(const Channel& ch, const std::vector<uint8_t>& values, bool sameCycle) {
+		for (size_t j = 0; j < ch.Nets.size(); j++) {
+			if (ch.SameCycle[j] == sameCycle) engine->Set(ch.Nets[j], values[j] == 2 ? -1 : values[j]);
+		}
+	}
+
+	//执行本分区的全部周期，结束后把自己写的网络放进共享内存
+	void RunPartition() {
+		engine = std::make_unique<FlatEngine>(program);
+		Status* status = StatusOf(self);
+		const uint64_t cycles = Head()->Cycles;
+		std::vector<const Channel*> incoming, outgoing;
+		for (const Channel& ch : channels) {
+			if (ch.To == self) incoming.push_back(&ch);
+			if (ch.From == self) outgoing.push_back(&ch);
+		}
+		//上一周期的值：同一周期的通道先收下本周期的消息，其中读上一周期的网络下个周期再用
+		std::vector<std::vector<uint8_t>> previous(incoming.size());
+		for (size_t k = 0; k < incoming.size(); k++) {
+			for (uint32_t n : incoming[k]->Nets) {
+				int v = engine->Value(n);
+				previous[k].push_back(v == -1 ? 2 : uint8_t(v));
+			}
+		}
+		std::vector<uint8_t> message;
+		double stall = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t t = 0; t < cycles; t++) {
+			for (size_t k = 0; k < incoming.size(); k++) {
+				const Channel& ch = *incoming[k];
+				if (ch.Waits) {
+					Apply(ch, previous[k], false);
+					Pop(ch, message, stall);
+					Apply(ch, message, true);
+					previous[k].swap(message);
+				}
+				else if (t > 0) {
+					Pop(ch, message, stall);
+					Apply(ch, message, false);
+				}
+			}
+			engine->Run(1);
+			for (const Channel* ch : outgoing) Push(*ch, stall);
+			status->Cycle.store(t + 1, std::memory_order_release);
+		}
+		uint8_t* snapshot = base + snapshotOffset;
+		for (uint32_t n : owned[self]) {
+			int v = engine->Value(n);
+			snapshot[n] = v == -1 ? 2 : uint8_t(v);
+		}
+		status->BusySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - stall;
+		status->StallSeconds = stall;
+		status->Done.store(1, std::memory_order_release);
+	}
+
+	DistributedSimulation(const std::string& designName, const std::string& name, uint32_t index)
+		: design(designName), mappingName(name), self(index) {
+		Plan();
+	}
+
+public:
+	//父进程：构建设计并作为0号分区；name 为共享内存名的前缀
+	explicit DistributedSimulation(const std::string& designName, const std::string& name = "LogicElecDist")
+		: DistributedSimulation(designName, name + "." + std::to_string(GetCurrentProcessId()), 0) {}
+
+	~DistributedSimulation() {
+		if (base) UnmapViewOfFile(base);
+		if (mapping) CloseHandle(mapping);
+	}
+
+	DistributedSimulation(const DistributedSimulation&) = delete;
+	DistributedSimulation& operator=(const DistributedSimulation&) = delete;
+
+	//父进程构建的设计，Run 之后其中的位是最终的网络值
+	const PartitionedDesign& Design() const { return built; }
+
+	//启动各分区进程并执行 cycles 个周期；分区进程从头构建设计，所以每个对象只能执行一次
+	const Report& Run(size_t cycles) {
+		if (ran) throw std::runtime_error("A distributed simulation runs once; create a new one to run again");
+		ran = true;
+		const uint32_t partitions = uint32_t(built.Parts.size() + 1);
+		Map(true);
+		std::memset(base, 0, bytes);
+		Head()->Magic = MagicValue;
+		Head()->Partitions = partitions;
+		Head()->Cycles = cycles;
+		Head()->NetCount = program->InitialNets.size();
+
+		char path[MAX_PATH];
+		GetModuleFileNameA(nullptr, path, MAX_PATH);
+		auto finish = [&] {
+			for (PROCESS_INFORMATION& pi : processes) {
+				WaitForSingleObject(pi.hProcess, INFINITE);
+			}
+		};
+		auto start = std::chrono::steady_clock::now();
+		try {
+			for (uint32_t p = 1; p < partitions; p++) {
+				std::string command = "\"" + std::string(path) + "\" --partition " + design + " " + mappingName + " " + std::to_string(p);
+				STARTUPINFOA si{};
+				si.cb = sizeof(si);
+				PROCESS_INFORMATION pi{};
+				if (!CreateProcessA(nullptr, command.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi)) {
+					throw std::runtime_error("Cannot start partition process " + std::to_string(p));
+				}
+				processes.push_back(pi);
+			}
+			RunPartition();
+		}
+		catch (...) {
+			Head()->Abort.store(1, std::memory_order_release);
+			finish();
+			for (PROCESS_INFORMATION& pi : processes) {
+				CloseHandle(pi.hThread);
+				CloseHandle(pi.hProcess);
+			}
+			processes.clear();
+			throw;
+		}
+		finish();
+		report.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		report.Cycles = cycles;
+		report.Channels = channels.size();
+		report.Partitions.assign(partitions, {});
+		bool failed = false;
+		for (uint32_t p = 0; p < partitions; p++) {
+			PartitionStats& s = report.Partitions[p];
+			s.Instructions = instructions[p];
+			for (const Channel& ch : channels) {
+				if (ch.To == p) s.Received += ch.Nets.size();
+				if (ch.From == p) s.Sent += ch.Nets.size();
+			}
+			s.BusySeconds = StatusOf(p)->BusySeconds;
+			s.StallSeconds = StatusOf(p)->StallSeconds;
+			if (!StatusOf(p)->Done.load(std::memory_order_acquire)) failed = true;
+		}
+		for (PROCESS_INFORMATION& pi : processes) {
+			CloseHandle(pi.hThread);
+			CloseHandle(pi.hProcess);
+		}
+		processes.clear();
+		if (failed) throw std::runtime_error("A partition process did not finish");
+
+		//其他分区写的网络取最终值，写回父进程的位
+		const uint8_t* snapshot = base + snapshotOffset;
+		for (uint32_t p = 1; p < partitions; p++) {
+			for (uint32_t n : owned[p]) engine->Set(n, snapshot[n] == 2 ? -1 : snapshot[n]);
+		}
+		engine->SyncToBits();
+		return report;
+	}
+
+	//分区进程入口：main 收到 --partition <设计> <共享内存名> <分区号> 时调用，返回进程退出码
+	static int Worker(int argc, char* argv[]) {
+		if (argc < 5) return 2;
+		std::unique_ptr<DistributedSimulation> sim;
+		try {
+			sim.reset(new DistributedSimulation(argv[2], argv[3], uint32_t(std::stoul(argv[4]))));
+			sim->Map(false);
+			if (sim->Head()->Magic != MagicValue || sim->Head()->NetCount != sim->program->InitialNets.size()) {
+				throw std::runtime_error("Partition process built a different design");
+			}
+			sim->RunPartition();
+			return 0;
+		}
+		catch (const std::exception& e) {
+			if (sim && sim->base) sim->Head()->Abort.store(1, std::memory_order_release);
+			std::print("Partition {}: {}\n", argv[4], e.what());
+			return 1;
+		}
+	}
+};
@@ -11,6 +11,19 @@
 #include<thread>
 #include<queue>
 #include<mutex>
+#include<condition_variable>
+#include<atomic>
+#include<algorithm>
+#include<unordered_map>
+#include<unordered_set>
+#include<functional>
+#include<set>
+#include<typeinfo>
+#include<memory>
+#if defined(__GNUC__)
+#include<cxxabi.h>
+#endif
+#include"logicvector.hpp"
 int GetInputNonBlocking() {
 	if (_kbhit()) {
 		return _getch();
@@ -18,6 +31,32 @@ int GetInputNonBlocking() {
 	return -1;
 }
 
+//输入通知：输入线程放入新数据后递增序号并唤醒等待者（实时运行器静止时在这里阻塞）
+struct InputSignal {
+	static inline std::mutex mtx;
+	static inline std::condition_variable cv;
+	static inline uint64_t serial = 0;
+
+	static void Notify() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			serial++;
+		}
+		cv.notify_all();
+	}
+
+	static uint64_t Serial() {
+		std::lock_guard<std::mutex> lock(mtx);
+		return serial;
+	}
+
+	//等到序号不同于 seen 或超时，返回是否有新通知
+	static bool Wait(uint64_t seen, std::chrono::milliseconds timeout) {
+		std::unique_lock<std::mutex> lock(mtx);
+		return cv.wait_for(lock, timeout, [seen] { return serial != seen; });
+	}
+};
+
 //bit位，便于抽象
 class Bit {
 private:
@@ -61,9 +100,34 @@ public:
 	}
 };
 
+inline Logic ToLogic(const Bit& bit) {
+	return bit.isHighZ() ? Logic::Z : (bit.isOne() ? Logic::One : Logic::Zero);
+}
+
+//写回 Bit：Z 为高阻，X 按0
+inline Bit ToBit(Logic v) {
+	Bit bit(v == Logic::One);
+	if (v == Logic::Z) bit = -1;
+	return bit;
+}
+
+class Unit;
+
+//总线引用：单元上从 first 开始的 width 个连续引脚
+struct BusRef {
+	Unit* unit;
+	size_t first;
+	size_t width;
+};
+
 //电路单元
 class Unit {
 	friend class circuit;
+	friend class Netlist;
+	friend class Partitioner;
+	friend class ActivityMonitor;
+	friend class RealTimeRunner;
+	friend struct LogicVector;
 protected:
 	class Node {
 	public:
@@ -97,6 +161,26 @@ protected:
 			return *Output;
 		}
 
+		//四值解析：高阻的驱动让给其他驱动，同时驱动0和1时为 X（Value() 按线或得1，看不到冲突）
+		Logic Resolve4() const {
+			if (Inputs.empty()) return ToLogic(*Output);
+			Logic value = Logic::Z;
+			for (const Bit* input : Inputs) value = ::Resolve(value, ToLogic(*input));
+			return value;
+		}
+
+		//不检查空指针的线或解析，Validate() 通过后使用
+		Bit& Resolve() {
+			if (Inputs.empty()) return *Output;
+			Bit Value = false;
+			for (Bit* input : Inputs) {
+				if (input->isHighZ()) continue;
+				Value = Value | *input;
+			}
+			*Output = Value;
+			return *Output;
+		}
+
 		void Connect(Bit* bit) {
 			Inputs.push_back(bit);
 		}
@@ -104,15 +188,69 @@ protected:
 
 	std::vector<Node> Inputs;
 	std::vector<Node> Outputs;
-	std::vector<Unit*> Requires;
+	std::vector<Unit*> Requires;//依赖的单元，按连接顺序、不重复
+	std::unique_ptr<std::unordered_set<Unit*>> RequireIndex;//依赖超过 RequireScan 个时建立的哈希索引
+	static constexpr size_t RequireScan = 8;
+	bool Checked = true;//Validate() 通过后为 false，访问函数不再逐次检查
 	//单元内部连接，用于连接子原件
 	void SetInput(size_t InputIndex, Unit* _unit, size_t _InputIndex) {
+		CheckRange(InputIndex, 1, Inputs.size());
+		CheckRange(_InputIndex, 1, _unit->Inputs.size());
 		_unit->Inputs[_InputIndex] = Inputs[InputIndex];
 	}
 	//单元内部连接，用于连接子原件
 	void SetOutput(size_t OutputIndex, Unit* _unit, size_t _OutputIndex) {
+		CheckRange(OutputIndex, 1, Outputs.size());
+		CheckRange(_OutputIndex, 1, _unit->Outputs.size());
 		_unit->Outputs[_OutputIndex] = Outputs[OutputIndex];
 	}
+	//按总线绑定输入，InputFirst 起的 bus.width 个输入依次绑定到子原件
+	void SetInputBus(size_t InputFirst, BusRef bus) {
+		CheckRange(InputFirst, bus.width, Inputs.size());
+		CheckRange(bus.first, bus.width, bus.unit->Inputs.size());
+		for (size_t i = 0; i < bus.width; i++) {
+			bus.unit->Inputs[bus.first + i] = Inputs[InputFirst + i];
+		}
+	}
+	//按总线绑定输出
+	void SetOutputBus(size_t OutputFirst, BusRef bus) {
+		CheckRange(OutputFirst, bus.width, Outputs.size());
+		CheckRange(bus.first, bus.width, bus.unit->Outputs.size());
+		for (size_t i = 0; i < bus.width; i++) {
+			bus.unit->Outputs[bus.first + i] = Outputs[OutputFirst + i];
+		}
+	}
+
+	//依赖通常只有几个，只用数组保存，判重最多扫描 RequireScan 个；更多时再建哈希索引，判重仍是常数时间
+	void AddRequire(Unit* unit) {
+		if (DependsOn(unit)) return;
+		Requires.push_back(unit);
+		if (RequireIndex) RequireIndex->insert(unit);
+		else if (Requires.size() > RequireScan) {
+			RequireIndex = std::make_unique<std::unordered_set<Unit*>>(Requires.begin(), Requires.end());
+		}
+	}
+	bool DependsOn(Unit* unit) const {
+		if (RequireIndex) return RequireIndex->count(unit) != 0;
+		return std::find(Requires.begin(), Requires.end(), unit) != Requires.end();
+	}
+	bool RemoveRequire(Unit* unit) {
+		if (!DependsOn(unit)) return false;
+		Requires.erase(std::find(Requires.begin(), Requires.end(), unit));
+		if (RequireIndex) RequireIndex->erase(unit);
+		return true;
+	}
+	void SetRequires(const std::vector<Unit*>& units) {
+		Requires.clear();
+		RequireIndex.reset();
+		for (Unit* unit : units) AddRequire(unit);
+	}
+
+	static void CheckRange(size_t first, size_t width, size_t size) {
+		if (first > size || width > size - first) {
+			throw std::out_of_range("Bus range out of range");
+		}
+	}
 public:
 	//输入输出数量由构造函数指定
 	Unit(size_t inputCount, size_t outputCount) {
@@ -120,10 +258,30 @@ public:
 		Outputs.resize(outputCount);
 	}
 	virtual bool isSequential() const { return false; }
+	//输出可能为高阻（三态门等），这样的输出可以与其他输出接在同一个输入上
+	virtual bool CanFloat() const { return false; }
+	//外部输入源（键盘、标准输入），实时运行器据此判断线路是否可能被唤醒
+	virtual bool IsInputSource() const { return false; }
+	//有尚未被 Do() 取走的输入
+	virtual bool HasPendingInput() { return false; }
+	//输出只由当前输入决定、没有内部状态（只读存储器等），周期检测可以把它当作组合逻辑
+	virtual bool IsStateless() const { return false; }
 	//必须实现的函数，执行单元的逻辑
 	virtual void Do() {}
+	//四值求值：inputs 为按 Node::Resolve4 解析的输入，结果写入 outputs；不支持四值的单元返回 false
+	virtual bool EvaluateLogic(const LogicVector&, LogicVector&) const { return false; }
+	//按四值执行一次：输入冲突和未知都能传到输出，返回输出向量，写回 Bit 时 X 按0
+	LogicVector DoLogic() {
+		LogicVector outputs;
+		if (!EvaluateLogic(LogicVector::ResolveInputs(*this), outputs)) {
+			throw std::runtime_error("Unit has no four-valued evaluation");
+		}
+		for (size_t i = 0; i < Outputs.size(); i++) *Outputs[i].Output = ToBit(outputs.Get(i));
+		return outputs;
+	}
 	//为对应位设置输入数据
 	Bit& Input(size_t index) {
+		if (!Checked) return Inputs[index].Resolve();
 		if (index >= Inputs.size()) {
 			throw std::out_of_range("Input index out of range");
 		}
@@ -131,6 +289,7 @@ public:
 	}
 	//为对应位设置输出数据
 	Bit& Output(size_t index) {
+		if (!Checked) return *Outputs[index].Output;
 		if (index >= Outputs.size()) {
 			throw std::out_of_range("Input index out of range");
 		}
@@ -138,12 +297,38 @@ public:
 	}
 	//连接两个单元的输入输出，outputIndex是当前单元的输出索引，inputIndex是另一个单元的输入索引
 	void Connect(size_t outputIndex, Unit* other, size_t inputIndex) {
+		CheckRange(outputIndex, 1, Outputs.size());
+		CheckRange(inputIndex, 1, other->Inputs.size());
 		other->Inputs[inputIndex].Connect(Outputs[outputIndex].Output);
-		if (std::find(other->Requires.begin(), other->Requires.end(), this) == other->Requires.end())
-			other->Requires.push_back(this);
+		other->AddRequire(this);
+	}
+	//取从 first 开始的 width 个引脚作为总线
+	BusRef Bus(size_t first, size_t width) {
+		return BusRef{ this, first, width };
+	}
+	//按总线连接，outputFirst 起的 to.width 个输出依次连接到另一个单元的输入
+	void ConnectBus(size_t outputFirst, BusRef to) {
+		CheckRange(outputFirst, to.width, Outputs.size());
+		CheckRange(to.first, to.width, to.unit->Inputs.size());
+		for (size_t i = 0; i < to.width; i++) {
+			to.unit->Inputs[to.first + i].Connect(Outputs[outputFirst + i].Output);
+		}
+		to.unit->AddRequire(this);
 	}
 };
 
+inline LogicVector LogicVector::FromBits(const std::vector<const Bit*>& bits) {
+	LogicVector v(bits.size(), Logic::Zero);
+	for (size_t i = 0; i < bits.size(); i++) v.Set(i, ToLogic(*bits[i]));
+	return v;
+}
+
+inline LogicVector LogicVector::ResolveInputs(Unit& unit) {
+	LogicVector v(unit.Inputs.size(), Logic::Z);
+	for (size_t i = 0; i < unit.Inputs.size(); i++) v.Set(i, unit.Inputs[i].Resolve4());
+	return v;
+}
+
 //测量门
 class Measure :public Unit {
 public:
@@ -287,6 +472,9 @@ public:
 class ManualInput : public Unit {
 public:
 	ManualInput(int n) : Unit(0, n) {}
+	//每次 Do() 都阻塞读取标准输入，视为始终有输入
+	bool IsInputSource() const override { return true; }
+	bool HasPendingInput() override { return true; }
 
 	void Do() override {
 		for (size_t i = 0; i < Outputs.size(); ++i) {
@@ -301,6 +489,9 @@ public:
 class ManualInput8bitBlock : public Unit {
 public:
 	ManualInput8bitBlock() : Unit(0, 8) {}
+	//每次 Do() 都阻塞读取标准输入，视为始终有输入
+	bool IsInputSource() const override { return true; }
+	bool HasPendingInput() override { return true; }
 
 	void Do() override {
 		int value;
@@ -315,6 +506,9 @@ class ManualInputNbitBlock : public Unit {
 public:
 	std::string Name;
 	ManualInputNbitBlock(int n) : Unit(0, n) {}
+	//每次 Do() 都阻塞读取标准输入，视为始终有输入
+	bool IsInputSource() const override { return true; }
+	bool HasPendingInput() override { return true; }
 
 	void Do() override {
 		int value;
@@ -328,6 +522,9 @@ public:
 class ManualInput8bitBlockByBit : public Unit {
 public:
 	ManualInput8bitBlockByBit() : Unit(0, 8) {}
+	//每次 Do() 都阻塞读取标准输入，视为始终有输入
+	bool IsInputSource() const override { return true; }
+	bool HasPendingInput() override { return true; }
 
 	void Do() override {
 		int value;
@@ -344,6 +541,9 @@ class ManualInputNbitBlockByBit : public Unit {
 public:
 	std::string Name;
 	ManualInputNbitBlockByBit(int n) : Unit(0, n) {}
+	//每次 Do() 都阻塞读取标准输入，视为始终有输入
+	bool IsInputSource() const override { return true; }
+	bool HasPendingInput() override { return true; }
 
 	void Do() override {
 		int value;
@@ -368,8 +568,11 @@ private:
 		while (running) {
 			int val;
 			std::cin >> val;
-			std::lock_guard<std::mutex> lock(mtx);
-			inputQueue.push(val);
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				inputQueue.push(val);
+			}
+			InputSignal::Notify();
 		}
 	}
 
@@ -378,6 +581,13 @@ public:
 		worker = std::thread(&ManualInput8bit::inputLoop, this);
 	}
 
+	bool CanFloat() const override { return true; }
+	bool IsInputSource() const override { return true; }
+	bool HasPendingInput() override {
+		std::lock_guard<std::mutex> lock(mtx);
+		return !inputQueue.empty();
+	}
+
 	~ManualInput8bit() {
 		running = false;
 		if (worker.joinable())
@@ -418,6 +628,10 @@ public:
 	// 输入：时钟 (索引 0)
 	// 输出：8位数据 (索引 0-7)，有效标志 (索引 8)
 	KeyInput8bit() : Unit(1, 9) {}
+	bool CanFloat() const override { return true; }
+	//控制台按键没有通知线程，运行器静止时定期查询
+	bool IsInputSource() const override { return true; }
+	bool HasPendingInput() override { return _kbhit() != 0; }
 
 	virtual bool isSequential() const override { return true; }
 
@@ -445,6 +659,7 @@ public:
 class ASCIIToDigit : public Unit {
 public:
 	ASCIIToDigit() : Unit(8, 4) {} // 8 位 ASCII 输入，4 位数值输出
+	bool CanFloat() const override { return true; }
 
 	void Do() override {
 		// 读取 ASCII 码
@@ -475,6 +690,14 @@ public:
 	}
 };
 
+class PullDown : public Unit {
+public:
+	PullDown() : Unit(0, 1) {}        // 无输入，一个输出
+	void Do() override {
+		Output(0) = 0;                 // 固定输出 0，给门级电路提供常0输入
+	}
+};
+
 //同一个单元内可以直接使用Bit类运算来简化
 class AndGate : public Unit {
 public:
@@ -604,6 +827,11 @@ public:
 			Output(i) = Input(i) & Input(i + Nbit);
 		}
 	}
+
+	bool EvaluateLogic(const LogicVector& in, LogicVector& out) const override {
+		out = in.Slice(0, Nbit) & in.Slice(Nbit, Nbit);
+		return true;
+	}
 };
 
 class AndGateNBit_nInput : public Unit {
@@ -622,6 +850,14 @@ public:
 		}
 
 	}
+
+	bool EvaluateLogic(const LogicVector& in, LogicVector& out) const override {
+		out = LogicVector(Nbit, Logic::One);
+		for (size_t j = 0; j < Inputs.size() / Nbit; ++j) {
+			LogicVector::Apply<Logic4Kernel::And>(out, in.Slice(j * Nbit, Nbit), out);
+		}
+		return true;
+	}
 };
 //n位或
 class OrGateNBit :public Unit {
@@ -635,6 +871,11 @@ public:
 			Output(i) = Input(i) | Input(i + Nbit);
 		}
 	}
+
+	bool EvaluateLogic(const LogicVector& in, LogicVector& out) const override {
+		out = in.Slice(0, Nbit) | in.Slice(Nbit, Nbit);
+		return true;
+	}
 };
 
 //n位多输入或
@@ -654,6 +895,14 @@ public:
 		}
 
 	}
+
+	bool EvaluateLogic(const LogicVector& in, LogicVector& out) const override {
+		out = LogicVector(Nbit, Logic::Zero);
+		for (size_t j = 0; j < Inputs.size() / Nbit; ++j) {
+			LogicVector::Apply<Logic4Kernel::Or>(out, in.Slice(j * Nbit, Nbit), out);
+		}
+		return true;
+	}
 };
 
 //n位异或
@@ -668,6 +917,11 @@ public:
 			Output(i) = Input(i) & !Input(i + Nbit) | !Input(i) & Input(i + Nbit);
 		}
 	}
+
+	bool EvaluateLogic(const LogicVector& in, LogicVector& out) const override {
+		out = in.Slice(0, Nbit) ^ in.Slice(Nbit, Nbit);
+		return true;
+	}
 };
 
 //n位非
@@ -682,6 +936,11 @@ public:
 			Output(i) = !Input(i);
 		}
 	}
+
+	bool EvaluateLogic(const LogicVector& in, LogicVector& out) const override {
+		out = !in;
+		return true;
+	}
 };
 
 //特殊单元
@@ -704,15 +963,24 @@ public:
 class DFlipFlop : public Unit {
 	Bit q;
 	bool lastClock = false;
+	bool sampled = false;
 public:
 	virtual bool isSequential() const { return true; }
 	DFlipFlop() : Unit(2, 1) {} // 输入：D, CLK
+	//指定初值，视为已经采样过
+	explicit DFlipFlop(bool initial) : Unit(2, 1), q(initial), sampled(true) {
+		Output(0) = q;
+	}
+	//还没有采样过时 Q 读作0，实际状态未知（四值仿真中为 X）
+	bool Sampled() const { return sampled; }
 	void Do() override {
 		bool clk = (Input(1) == 1);
 		if (!lastClock && clk) {// 上升沿检测
 			q = Input(0);// 采样 D
+			sampled = true;
 		}
 		lastClock = clk;
+		//经节点解析的输入不会是高阻（悬空的驱动读作0），只有 D 位本身被直接置为高阻时才保持原输出
 		if (q == -1) {
 			return;//高阻状态不更新输出
 		}
@@ -724,6 +992,7 @@ class TriStateGate : public Unit {
 public:
 	// 构造函数：2个输入（数据，使能），1个输出
 	TriStateGate() : Unit(2, 1) {}
+	bool CanFloat() const override { return true; }
 
 	void Do() override {
 		if (int(Input(1)) == 1) {// 使能有效，输出等于输入数据
@@ -767,15 +1036,185 @@ public:
 	}
 };
 
+//一个8位总线单元
+class Bus8bit : public Unit {
+public:
+	Bus8bit() :Unit(8, 8) {}
+
+	void Do() override {
+		for (int i = 0; i < 8; ++i) {
+			Output(i) = Input(i);
+		}
+	}
+};
+
 //线路类，包含多个单元
 class circuit {
+	friend class Netlist;
+	friend class Partitioner;
+	friend class ActivityMonitor;
+	friend class RealTimeRunner;
+	friend class DistributedSimulation;
+	friend class CycleSkipper;
 private:
 	std::vector<Unit*> comboUnits;
 	std::vector<Unit*> seqUnits;
 	bool IsSorted = false;
 	bool IsInitialized = false;
+	size_t cycle = 0;//已执行的周期数
+	std::unordered_map<std::string, Bit*> namedNets;//命名网络，供监视条件查找
+	struct CycleHook {
+		size_t Id;
+		std::function<void(circuit&)> Hook;
+	};
+	std::vector<CycleHook> cycleHooks;
+	size_t lastHookId = 0;
+
+	bool HasCycleCallbacks() const { return OnCycle || !cycleHooks.empty(); }
+	//一个周期结束：先调用 OnCycle，再调用附加回调
+	void CycleDone() {
+		if (OnCycle) OnCycle(*this);
+		for (size_t i = 0; i < cycleHooks.size(); i++) cycleHooks[i].Hook(*this);
+	}
+
+	//执行一个周期，不做初始化和排序检查，调用前必须 Prepare
+	void Step() {
+		// 阶段1：计算所有组合单元
+		for (Unit* u : comboUnits) {
+			u->Do();
+		}
+
+		// 阶段2：更新所有时序单元
+		for (Unit* u : seqUnits) {
+			u->Do();
+		}
+	}
+
+	//类型名：去掉 MSVC typeid 名字中的 class/struct 前缀，GCC/Clang 下还原修饰过的名字
+	template<class T> static std::string TypeName(const T& object) {
+		std::string name = typeid(object).name();
+#if defined(__GNUC__)
+		int status = 0;
+		if (char* demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status)) {
+			if (status == 0) name = demangled;
+			std::free(demangled);
+		}
+#endif
+		for (const char* prefix : { "class ", "struct " }) {
+			if (name.rfind(prefix, 0) == 0) name.erase(0, std::char_traits<char>::length(prefix));
+		}
+		return name;
+	}
+
+	//层次中直接包含 unit 的线路
+	circuit* Owner(Unit* unit) {
+		std::vector<circuit*> pending{ this };
+		while (!pending.empty()) {
+			circuit* c = pending.back();
+			pending.pop_back();
+			for (auto* units : { &c->comboUnits, &c->seqUnits }) {
+				for (Unit* u : *units) {
+					if (u == unit) return c;
+					if (circuit* sub = dynamic_cast<circuit*>(u)) pending.push_back(sub);
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	//在本线路内用 replacement 替换 old，见 Replace()
+	void Swap(Unit* old, Unit* replacement) {
+		if (!replacement || replacement == old) {
+			throw std::runtime_error("Invalid replacement unit");
+		}
+		if (replacement->Inputs.size() != old->Inputs.size() || replacement->Outputs.size() != old->Outputs.size()) {
+			throw std::runtime_error("Replacement must have the same number of inputs and outputs");
+		}
+		circuit* sub = dynamic_cast<circuit*>(replacement);
+		if (sub && sub->IsInitialized) {
+			throw std::runtime_error("Replacement circuit is already initialized");
+		}
+		std::vector<Unit*>& from = old->isSequential() ? seqUnits : comboUnits;
+		auto slot = std::find(from.begin(), from.end(), old);
+		if (slot == from.end()) {
+			throw std::runtime_error("Unit is not part of this circuit");
+		}
+
+		//兄弟单元对 old 的依赖改为对 replacement
+		auto redirect = [&](Unit* a, Unit* b) {
+			for (auto* units : { &comboUnits, &seqUnits }) {
+				for (Unit* u : *units) {
+					if (u->RemoveRequire(a)) u->AddRequire(b);
+				}
+			}
+		};
+		replacement->SetRequires(old->Requires);
+		redirect(old, replacement);
+		if (replacement->isSequential() == old->isSequential()) {
+			*slot = replacement;
+		}
+		else if (old->isSequential()) {
+			try {
+				InsertSorted(comboUnits, replacement);
+			}
+			catch (...) {
+				redirect(replacement, old);
+				replacement->SetRequires({});
+				throw;
+			}
+			seqUnits.erase(std::find(seqUnits.begin(), seqUnits.end(), old));
+		}
+		else {
+			//组合单元去掉一个后原顺序仍然有效
+			comboUnits.erase(slot);
+			seqUnits.push_back(replacement);
+		}
+		replacement->Inputs = old->Inputs;
+		replacement->Outputs = old->Outputs;
+		if (sub) sub->Prepare();
+	}
+
+	//把组合单元插入已排好序的 units：位置在它依赖的单元之后、依赖它的单元之前
+	//两者冲突时只对这两个位置之间的一段重新排序，段外的顺序不变；有环时抛出异常且不修改 units
+	static void InsertSorted(std::vector<Unit*>& units, Unit* unit) {
+		size_t after = 0, before = units.size();
+		for (size_t i = 0; i < units.size(); i++) {
+			if (unit->DependsOn(units[i])) after = i + 1;
+			if (before == units.size() && units[i]->DependsOn(unit)) before = i;
+		}
+		if (after <= before) {
+			units.insert(units.begin() + after, unit);
+			return;
+		}
+		std::vector<Unit*> window(units.begin() + before, units.begin() + after);
+		window.push_back(unit);
+		TopologicalSort(window);
+		units.insert(units.begin() + after, nullptr);
+		std::copy(window.begin(), window.end(), units.begin() + before);
+	}
 public:
 	std::string name;
+	//每个周期结束后调用（例如翻转计数），未设置时不产生额外开销
+	std::function<void(circuit&)> OnCycle;
+
+	//附加的周期回调（监视器、指标发布等），在 OnCycle 之后按加入顺序调用
+	//各自按返回的编号移除，加入和移除的先后顺序互不影响，也不改动 OnCycle
+	size_t AddCycleHook(std::function<void(circuit&)> hook) {
+		cycleHooks.push_back({ ++lastHookId, std::move(hook) });
+		return lastHookId;
+	}
+	void RemoveCycleHook(size_t id) {
+		auto it = std::find_if(cycleHooks.begin(), cycleHooks.end(), [&](const CycleHook& h) { return h.Id == id; });
+		if (it != cycleHooks.end()) cycleHooks.erase(it);
+	}
+
+	//监视条件：命名网络的值（0/1，-1表示高阻）
+	struct Watch {
+		std::string Net;
+		int Value;
+	};
+	//多个监视条件的组合方式
+	enum class WatchMode { All, Any };
 
 	circuit& AddUnit(Unit* unit) {
 		if (unit->isSequential())
@@ -788,45 +1227,369 @@ public:
 	}
 
 	//拓扑排序，保证每个单元的依赖都在它之前执行
+	//按入度逐层输出，时间与单元数和连接数成线性
 	void Sort() {
 		if (IsSorted) return;
-
 		// 只对组合单元进行拓扑排序
+		TopologicalSort(comboUnits);
+		IsSorted = true;
+	}
+
+	//原地排序一组组合单元，只考虑组内的依赖；有环时抛出异常且不修改 units
+	static void TopologicalSort(std::vector<Unit*>& units) {
+		size_t n = units.size();
+		std::unordered_map<Unit*, size_t> position;
+		position.reserve(n);
+		for (size_t i = 0; i < n; i++) {
+			position.emplace(units[i], i);
+		}
+
+		std::vector<size_t> indegree(n, 0);
+		std::vector<std::vector<size_t>> dependents(n);
+		for (size_t i = 0; i < n; i++) {
+			for (Unit* req : units[i]->Requires) {
+				// 如果依赖是时序单元，忽略（因为时序单元的输出是已知的当前值）
+				if (req->isSequential()) continue;
+				auto it = position.find(req);
+				if (it == position.end()) continue;//不属于本线路的单元
+				indegree[i]++;
+				dependents[it->second].push_back(i);
+			}
+		}
+
 		std::vector<Unit*> sorted;
-		std::vector<Unit*> unsorted = comboUnits;
-
-		while (!unsorted.empty()) {
-			bool progress = false;
-			for (auto it = unsorted.begin(); it != unsorted.end();) {
-				Unit* unit = *it;
-				bool canSort = true;
-				for (Unit* req : unit->Requires) {
-					// 如果依赖是时序单元，忽略（因为时序单元的输出是已知的当前值）
-					if (req->isSequential()) continue;
-					// 否则要求 req 已在 sorted 中
-					if (std::find(sorted.begin(), sorted.end(), req) == sorted.end()) {
-						canSort = false;
-						break;
+		sorted.reserve(n);
+		std::vector<size_t> ready;
+		for (size_t i = 0; i < n; i++) {
+			if (indegree[i] == 0) ready.push_back(i);
+		}
+		for (size_t head = 0; head < ready.size(); head++) {
+			size_t i = ready[head];
+			sorted.push_back(units[i]);
+			for (size_t d : dependents[i]) {
+				if (--indegree[d] == 0) ready.push_back(d);
+			}
+		}
+		if (sorted.size() != n) {
+			throw std::runtime_error("Cyclic dependency in combinational logic");
+		}
+		units = std::move(sorted);
+	}
+
+	virtual void Init() {}
+
+	//单元的 Do() 只执行 Excute() 时为 true，行为级单元返回 false
+	virtual bool IsStructural() const { return true; }
+
+	//初始化并排序，递归处理所有子线路，只需执行一次
+	void Prepare() {
+		if (!IsInitialized) {
+			Init();
+			IsInitialized = true;
+		}
+		Sort();
+		for (Unit* u : comboUnits) {
+			if (circuit* sub = dynamic_cast<circuit*>(u)) sub->Prepare();
+		}
+		for (Unit* u : seqUnits) {
+			if (circuit* sub = dynamic_cast<circuit*>(u)) sub->Prepare();
+		}
+	}
+
+	//增量重新展开：用 replacement 原地替换层次中的 old，其余单元不重建也不重新排序
+	//replacement 接管 old 的引脚节点（同一组驱动指针和输出位），所以外部连线、命名网络和父线路的 SetOutput 绑定都不变，
+	//依赖 old 的兄弟单元改为依赖 replacement。子线路必须尚未初始化，接管引脚之后才执行它的 Init()，让内部绑定指向原来的位
+	//组合换组合、时序换时序时位置不变；时序换成组合时插到依赖之后、被依赖之前，两者冲突时只对中间一段重新排序
+	//其他单元的时序状态和所有网络的当前值都保留，old 及其子单元不再执行，由调用者决定是否释放
+	//已编译的 FlatProgram/Netlist 等不会随之更新，需要重新编译
+	void Replace(Unit* old, Unit* replacement) {
+		Prepare();
+		circuit* owner = Owner(old);
+		if (!owner) {
+			throw std::runtime_error("Unit is not part of this circuit");
+		}
+		owner->Swap(old, replacement);
+	}
+
+	//替换层次中所有满足 match 的单元，make 根据原单元创建替换单元；不进入新单元内部查找，返回替换的个数
+	size_t ReplaceAll(const std::function<bool(Unit&)>& match, const std::function<Unit*(Unit&)>& make) {
+		Prepare();
+		size_t count = 0;
+		std::vector<circuit*> pending{ this };
+		while (!pending.empty()) {
+			circuit* c = pending.back();
+			pending.pop_back();
+			//替换会改变单元列表，先取快照
+			std::vector<Unit*> units = c->comboUnits;
+			units.insert(units.end(), c->seqUnits.begin(), c->seqUnits.end());
+			for (Unit* u : units) {
+				if (match(*u)) {
+					c->Swap(u, make(*u));
+					count++;
+				}
+				else if (circuit* sub = dynamic_cast<circuit*>(u)) {
+					pending.push_back(sub);
+				}
+			}
+		}
+		return count;
+	}
+
+	//展开报告：每种子线路的个数和 Init()+Sort() 的累计时间（不含其子线路）
+	struct ElaborationReport {
+		struct Type {
+			std::string Name;
+			size_t Count = 0;
+			double Seconds = 0;
+		};
+		double Seconds = 0;
+		size_t Circuits = 0;
+		size_t Threads = 0;
+		std::vector<Type> Types;//按累计时间从大到小
+
+		void Print(size_t top = 20) const {
+			std::print("Elaborated {} circuits on {} threads in {:.3f} s\n", Circuits, Threads, Seconds);
+			for (size_t i = 0; i < Types.size() && i < top; i++) {
+				std::print("  {:>8} x {:<32} {:.3f} s\n", Types[i].Count, Types[i].Name, Types[i].Seconds);
+			}
+		}
+	};
+
+	//显式的展开阶段：在线程池上并行执行整个层次的 Init() 和 Sort()，之后 Excute() 不再做初始化
+	//兄弟子线路的 Init() 只修改自己子树内的单元，互不相关；每个线路初始化完成后，它的子线路才进入任务队列
+	//工作线程优先处理自己的子树，有空闲线程时把一半任务放回公共队列。threads 为 0 时使用全部硬件线程
+	ElaborationReport Elaborate(size_t threads = 0) {
+		if (threads == 0) threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+		auto begin = std::chrono::steady_clock::now();
+
+		std::mutex mtx;
+		std::condition_variable wake;
+		std::vector<circuit*> shared{ this };
+		size_t outstanding = 1;//已入队但尚未完成的线路（包括各线程的本地任务）
+		std::atomic<size_t> idle{ 0 };
+		std::exception_ptr failure;
+		std::vector<std::unordered_map<std::string, ElaborationReport::Type>> perThread(threads);
+
+		auto worker = [&](size_t id) {
+			std::vector<circuit*> local;
+			auto& types = perThread[id];
+			while (true) {
+				if (local.empty()) {
+					std::unique_lock<std::mutex> lock(mtx);
+					idle++;
+					wake.wait(lock, [&] { return !shared.empty() || outstanding == 0 || failure; });
+					idle--;
+					if (shared.empty()) return;
+					local.push_back(shared.back());
+					shared.pop_back();
+				}
+				circuit* c = local.back();
+				local.pop_back();
+				size_t children = 0;
+				try {
+					auto start = std::chrono::steady_clock::now();
+					if (!c->IsInitialized) {
+						c->Init();
+						c->IsInitialized = true;
+					}
+					c->Sort();
+					auto& type = types[TypeName(*c)];
+					type.Count++;
+					type.Seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					for (auto* units : { &c->comboUnits, &c->seqUnits }) {
+						for (Unit* u : *units) {
+							if (circuit* sub = dynamic_cast<circuit*>(u)) {
+								local.push_back(sub);
+								children++;
+							}
+						}
 					}
 				}
-				if (canSort) {
-					sorted.push_back(unit);
-					it = unsorted.erase(it);
-					progress = true;
+				catch (...) {
+					std::lock_guard<std::mutex> lock(mtx);
+					if (!failure) failure = std::current_exception();
+					shared.clear();
+					local.clear();
+					outstanding = 0;
+					wake.notify_all();
+					continue;
 				}
-				else {
-					++it;
+				std::lock_guard<std::mutex> lock(mtx);
+				if (failure) {
+					local.clear();
+					continue;
+				}
+				outstanding += children;
+				outstanding--;
+				//有线程在等待时分出一半本地任务
+				if (idle.load(std::memory_order_relaxed) > 0 && local.size() > 1) {
+					size_t give = local.size() / 2;
+					shared.insert(shared.end(), local.begin(), local.begin() + give);
+					local.erase(local.begin(), local.begin() + give);
+					wake.notify_all();
 				}
+				else if (outstanding == 0) wake.notify_all();
 			}
-			if (!progress) {
-				throw std::runtime_error("Cyclic dependency in combinational logic");
+		};
+
+		std::vector<std::thread> pool;
+		for (size_t i = 1; i < threads; i++) pool.emplace_back(worker, i);
+		worker(0);
+		for (std::thread& t : pool) t.join();
+		if (failure) std::rethrow_exception(failure);
+
+		ElaborationReport report;
+		report.Threads = threads;
+		std::unordered_map<std::string, ElaborationReport::Type> merged;
+		for (auto& types : perThread) {
+			for (auto& [name, t] : types) {
+				auto& m = merged[name];
+				m.Name = name;
+				m.Count += t.Count;
+				m.Seconds += t.Seconds;
+				report.Circuits += t.Count;
 			}
 		}
-		comboUnits = sorted;
-		IsSorted = true;
-	}
+		for (auto& [name, t] : merged) report.Types.push_back(t);
+		std::sort(report.Types.begin(), report.Types.end(),
+			[](const ElaborationReport::Type& a, const ElaborationReport::Type& b) { return a.Seconds > b.Seconds; });
+		report.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		return report;
+	}
+
+	//内存占用报告：按类别和单元类型统计层次中各部分的堆内存（估计值）
+	//每次堆分配按16字节对齐再加16字节块头计算（与 MSVC x64 堆相近）；unordered_map/unordered_set 按 MSVC 的链表加双指针桶估算
+	//单元对象按 Unit（子线路再加 circuit）的大小计算，派生类自己的成员和行为级单元另外分配的存储不计入
+	struct MemoryUsage {
+		struct Type {
+			std::string Name;
+			size_t Count = 0;
+			size_t Bytes = 0;       //单元自身，不含子单元
+			size_t Inclusive = 0;   //含全部子单元
+		};
+		//按类别的字节数
+		size_t Objects = 0;         //单元和线路对象
+		size_t NodeArrays = 0;      //Inputs/Outputs 节点数组
+		size_t DriverLists = 0;     //Node::Inputs 驱动指针数组
+		size_t Bits = 0;            //每个引脚 new 出来的 Bit
+		size_t Requires = 0;        //依赖表
+		size_t UnitLists = 0;       //comboUnits/seqUnits
+		size_t NamedNets = 0;
+		//规模
+		size_t Units = 0;
+		size_t Circuits = 0;
+		size_t BitCount = 0;        //不同的 Bit 对象（含输入节点的解析缓存）
+		size_t Nets = 0;            //不同的输出位
+		size_t Connections = 0;     //各输入节点的驱动指针数（子单元共享父单元的输入节点时各算一次）
+		std::vector<Type> Types;    //按含子单元的字节数从大到小
+
+		size_t Total() const { return Objects + NodeArrays + DriverLists + Bits + Requires + UnitLists + NamedNets; }
+
+		void Print(size_t top = 20) const {
+			std::print("Memory: {:.2f} MB in {} units ({} circuits), {} bits, {} nets, {} connections\n",
+				Total() / 1048576.0, Units, Circuits, BitCount, Nets, Connections);
+			const std::pair<const char*, size_t> categories[] = {
+				{ "objects", Objects }, { "node arrays", NodeArrays }, { "driver lists", DriverLists }, { "bits", Bits },
+				{ "requires", Requires }, { "unit lists", UnitLists }, { "named nets", NamedNets },
+			};
+			for (auto& [label, bytes] : categories) {
+				std::print("  {:<14} {:>12} bytes  {:5.1f}%\n", label, bytes, Total() ? 100.0 * bytes / Total() : 0.0);
+			}
+			std::print("  {:>8}   {:<32} {:>12} {:>12}\n", "count", "type", "self", "inclusive");
+			for (size_t i = 0; i < Types.size() && i < top; i++) {
+				std::print("  {:>8} x {:<32} {:>12} {:>12}\n", Types[i].Count, Types[i].Name, Types[i].Bytes, Types[i].Inclusive);
+			}
+			if (Units) std::print("  {:.0f} bytes per unit, {:.1f} bytes per connection\n",
+				double(Total()) / Units, Connections ? double(Total()) / Connections : 0.0);
+		}
+	};
 
-	virtual void Init() {}
+	MemoryUsage MemoryReport() {
+		Prepare();
+		MemoryUsage report;
+		std::unordered_map<std::string, MemoryUsage::Type> types;
+		std::unordered_set<const Bit*> bits;
+		std::unordered_set<const Bit*> nets;
+		auto heap = [](size_t bytes) -> size_t { return bytes ? (bytes + 15) / 16 * 16 + 16 : 0; };
+
+		//线路部分：单元列表和命名网络
+		auto circuitBytes = [&](const circuit& c) {
+			size_t lists = heap(c.comboUnits.capacity() * sizeof(Unit*)) + heap(c.seqUnits.capacity() * sizeof(Unit*));
+			size_t named = heap(c.namedNets.bucket_count() * 2 * sizeof(void*));
+			for (auto& [netName, bit] : c.namedNets) {
+				named += heap(3 * sizeof(void*) + sizeof(std::string) + sizeof(Bit*)) + (netName.capacity() >= 16 ? heap(netName.capacity() + 1) : 0);
+			}
+			report.UnitLists += lists;
+			report.NamedNets += named;
+			return lists + named;
+		};
+
+		//单元自身：对象、节点数组、驱动指针、依赖集合、第一次遇到的 Bit
+		auto unitBytes = [&](Unit& u) {
+			size_t object = heap(sizeof(Unit) + (dynamic_cast<circuit*>(&u) ? sizeof(circuit) : 0));
+			size_t nodes = heap(u.Inputs.capacity() * sizeof(Unit::Node)) + heap(u.Outputs.capacity() * sizeof(Unit::Node));
+			size_t drivers = 0, ownBits = 0;
+			for (auto* list : { &u.Inputs, &u.Outputs }) {
+				for (Unit::Node& node : *list) {
+					drivers += heap(node.Inputs.capacity() * sizeof(Bit*));
+					if (node.Output && bits.insert(node.Output).second) ownBits += heap(sizeof(Bit));
+				}
+			}
+			for (Unit::Node& node : u.Inputs) report.Connections += node.Inputs.size();
+			for (Unit::Node& node : u.Outputs) {
+				if (node.Output) nets.insert(node.Output);
+			}
+			size_t dependencies = heap(u.Requires.capacity() * sizeof(Unit*));
+			if (u.RequireIndex) {
+				dependencies += heap(sizeof(*u.RequireIndex)) + heap(u.RequireIndex->bucket_count() * 2 * sizeof(void*))
+					+ u.RequireIndex->size() * heap(3 * sizeof(void*));
+			}
+			report.Objects += object;
+			report.NodeArrays += nodes;
+			report.DriverLists += drivers;
+			report.Bits += ownBits;
+			report.Requires += dependencies;
+			return object + nodes + drivers + ownBits + dependencies;
+		};
+
+		std::function<size_t(Unit&)> visit = [&](Unit& u) -> size_t {
+			report.Units++;
+			size_t self = unitBytes(u), children = 0;
+			if (circuit* sub = dynamic_cast<circuit*>(&u)) {
+				report.Circuits++;
+				self += circuitBytes(*sub);
+				for (auto* units : { &sub->comboUnits, &sub->seqUnits }) {
+					for (Unit* v : *units) children += visit(*v);
+				}
+			}
+			MemoryUsage::Type& type = types[TypeName(u)];
+			type.Count++;
+			type.Bytes += self;
+			type.Inclusive += self + children;
+			return self + children;
+		};
+
+		//顶层线路本身不一定是单元
+		if (Unit* self = dynamic_cast<Unit*>(this)) {
+			visit(*self);
+		}
+		else {
+			circuitBytes(*this);
+			report.Objects += heap(sizeof(circuit));
+			for (auto* units : { &comboUnits, &seqUnits }) {
+				for (Unit* v : *units) visit(*v);
+			}
+		}
+		report.BitCount = bits.size();
+		report.Nets = nets.size();
+		for (auto& [typeName, t] : types) {
+			report.Types.push_back(t);
+			report.Types.back().Name = typeName;
+		}
+		std::sort(report.Types.begin(), report.Types.end(),
+			[](const MemoryUsage::Type& a, const MemoryUsage::Type& b) { return a.Inclusive > b.Inclusive; });
+		return report;
+	}
 
 	void Excute() {
 		if (!IsInitialized) {
@@ -834,20 +1597,245 @@ public:
 			IsInitialized = !IsInitialized;
 		}
 		Sort();
-		// 阶段1：计算所有组合单元
-		for (Unit* u : comboUnits) {
-			u->Do();
+		Step();
+		cycle++;
+		CycleDone();
+	}
+
+	//为单元的输出位命名，供 RunUntil 使用
+	circuit& NameNet(const std::string& netName, Unit* unit, size_t outputIndex) {
+		if (outputIndex >= unit->Outputs.size()) {
+			throw std::out_of_range("Output index out of range");
 		}
+		namedNets[netName] = unit->Outputs[outputIndex].Output;
+		return *this;
+	}
 
-		// 阶段2：更新所有时序单元
-		for (Unit* u : seqUnits) {
-			u->Do();
+	size_t Cycle() const { return cycle; }
+
+	//连续执行 cycles 个周期，返回累计周期数
+	size_t Run(size_t cycles) {
+		Prepare();
+		if (HasCycleCallbacks()) {
+			for (size_t i = 0; i < cycles; i++) {
+				Step();
+				cycle++;
+				CycleDone();
+			}
+			return cycle;
+		}
+		for (size_t i = 0; i < cycles; i++) {
+			Step();
+		}
+		cycle += cycles;
+		return cycle;
+	}
+
+	//执行直到监视条件满足或达到 maxCycles 个周期，返回累计周期数
+	//条件在循环外编译为位指针与期望值的比较
+	size_t RunUntil(const std::vector<Watch>& watches, size_t maxCycles, WatchMode mode = WatchMode::All) {
+		struct Compiled {
+			const Bit* net;
+			int value;
+		};
+		std::vector<Compiled> compiled;
+		compiled.reserve(watches.size());
+		for (const Watch& w : watches) {
+			auto it = namedNets.find(w.Net);
+			if (it == namedNets.end()) {
+				throw std::runtime_error("Unknown net: " + w.Net);
+			}
+			compiled.push_back({ it->second, w.Value });
+		}
+		const Compiled* begin = compiled.data();
+		const Compiled* end = begin + compiled.size();
+
+		Prepare();
+		for (size_t i = 0; i < maxCycles; i++) {
+			Step();
+			cycle++;
+			CycleDone();
+			bool hit = (mode == WatchMode::All);
+			for (const Compiled* w = begin; w != end; ++w) {
+				if ((int(*w->net) == w->value) != hit) {
+					hit = !hit;
+					break;
+				}
+			}
+			if (hit && begin != end) break;
+		}
+		return cycle;
+	}
+
+	//一次性检查整个层次的连线：空指针、输出上的驱动、未驱动的输入、非三态输出的多驱动和组合环路
+	//有问题时抛出异常，逐条给出层次位置；通过后所有单元改用不检查的访问函数
+	void Validate(size_t maxProblems = 50) {
+		struct Frame {
+			Unit* unit;
+			circuit* sub;   //结构级子线路，叶单元为 nullptr
+			size_t parent;
+			size_t index;   //在父线路中的序号
+		};
+		std::vector<Frame> frames;
+		frames.push_back({ dynamic_cast<Unit*>(this), this, 0, 0 });
+		std::vector<std::string> problems;
+
+		auto path = [&](size_t f) {
+			std::vector<std::string> parts;
+			for (;; f = frames[f].parent) {
+				circuit* c = frames[f].sub ? frames[f].sub : dynamic_cast<circuit*>(frames[f].unit);
+				if (f == 0) {
+					parts.push_back(name.empty() ? "top" : name);
+					break;
+				}
+				std::string part = (c && !c->name.empty()) ? c->name : TypeName(*frames[f].unit);
+				parts.push_back(part + "#" + std::to_string(frames[f].index));
+			}
+			std::string result;
+			for (size_t i = parts.size(); i-- > 0;) result += (i + 1 == parts.size() ? "" : "/") + parts[i];
+			return result;
+		};
+		auto report = [&](size_t f, const std::string& message) {
+			problems.push_back(path(f) + ": " + message);
+		};
+
+		//展开层次（不排序，环路由下面单独检查）
+		for (size_t f = 0; f < frames.size(); f++) {
+			circuit* c = frames[f].sub;
+			if (!c) continue;
+			if (!c->IsInitialized) {
+				c->Init();
+				c->IsInitialized = true;
+			}
+			size_t index = 0;
+			for (std::vector<Unit*>* list : { &c->comboUnits, &c->seqUnits }) {
+				for (Unit* u : *list) {
+					circuit* sub = dynamic_cast<circuit*>(u);
+					frames.push_back({ u, (sub && sub->IsStructural()) ? sub : nullptr, f, index++ });
+				}
+			}
+		}
+
+		//叶单元驱动的位
+		std::unordered_map<const Bit*, size_t> driver;
+		for (size_t f = 1; f < frames.size(); f++) {
+			if (frames[f].sub) continue;
+			for (auto& node : frames[f].unit->Outputs) {
+				if (node.Output) driver.emplace(node.Output, f);
+			}
+		}
+
+		std::set<std::vector<const Bit*>> reported;
+		for (size_t f = 1; f < frames.size(); f++) {
+			Unit* u = frames[f].unit;
+			Unit* owner = frames[frames[f].parent].unit;
+			for (size_t i = 0; i < u->Outputs.size(); i++) {
+				if (!u->Outputs[i].Output) report(f, "output " + std::to_string(i) + " has no bit");
+				else if (!u->Outputs[i].Inputs.empty()) report(f, "output " + std::to_string(i) + " is driven from outside");
+			}
+			for (size_t i = 0; i < u->Inputs.size(); i++) {
+				auto& node = u->Inputs[i];
+				std::string pin = "input " + std::to_string(i);
+				if (!node.Output) {
+					report(f, pin + " has no bit");
+					continue;
+				}
+				bool nullDriver = false;
+				for (Bit* bit : node.Inputs) nullDriver |= bit == nullptr;
+				if (nullDriver) {
+					report(f, pin + " has a null driver");
+					continue;
+				}
+				if (node.Inputs.empty()) {
+					//没有驱动时只允许是父单元输入的别名（SetInput 绑定）
+					bool bound = false;
+					if (owner) {
+						for (auto& outer : owner->Inputs) bound |= outer.Output == node.Output;
+					}
+					if (!bound) report(f, pin + " is not driven");
+					continue;
+				}
+				if (node.Inputs.size() < 2) continue;
+				std::vector<const Bit*> key(node.Inputs.begin(), node.Inputs.end());
+				std::sort(key.begin(), key.end());
+				if (!reported.insert(key).second) continue;
+				size_t solid = 0;
+				for (Bit* bit : node.Inputs) {
+					auto it = driver.find(bit);
+					if (it == driver.end() || !frames[it->second].unit->CanFloat()) solid++;
+				}
+				if (solid > 0) {
+					report(f, pin + " has " + std::to_string(node.Inputs.size()) + " drivers, "
+						+ std::to_string(solid) + " of them cannot go high-Z");
+				}
+			}
 		}
+
+		//每个线路内的组合环路
+		for (size_t f = 0; f < frames.size(); f++) {
+			circuit* c = frames[f].sub;
+			if (!c) continue;
+			std::vector<Unit*>& units = c->comboUnits;
+			std::unordered_map<Unit*, size_t> position;
+			for (size_t i = 0; i < units.size(); i++) position.emplace(units[i], i);
+			std::vector<std::vector<size_t>> depends(units.size());
+			for (size_t i = 0; i < units.size(); i++) {
+				for (Unit* req : units[i]->Requires) {
+					auto it = position.find(req);
+					if (it != position.end() && !req->isSequential()) depends[i].push_back(it->second);
+				}
+			}
+			//深度优先找回边，0 未访问 1 在栈上 2 已完成；用显式栈避免深层递归
+			std::vector<uint8_t> state(units.size(), 0);
+			std::vector<std::pair<size_t, size_t>> stack;//单元，下一个要看的依赖
+			bool found = false;
+			for (size_t root = 0; root < units.size() && !found; root++) {
+				if (state[root] != 0) continue;
+				stack.push_back({ root, 0 });
+				state[root] = 1;
+				while (!stack.empty() && !found) {
+					auto& [i, next] = stack.back();
+					if (next == depends[i].size()) {
+						state[i] = 2;
+						stack.pop_back();
+						continue;
+					}
+					size_t r = depends[i][next++];
+					if (state[r] == 0) {
+						state[r] = 1;
+						stack.push_back({ r, 0 });
+					}
+					else if (state[r] == 1) {
+						std::string loop;
+						size_t k = stack.size();
+						while (stack[k - 1].first != r) k--;
+						for (size_t j = k - 1; j < stack.size(); j++) {
+							size_t u = stack[j].first;
+							loop += TypeName(*units[u]) + "#" + std::to_string(u) + " <- ";
+						}
+						report(f, "combinational loop: " + loop + TypeName(*units[r]) + "#" + std::to_string(r));
+						found = true;
+					}
+				}
+				stack.clear();
+			}
+		}
+
+		if (!problems.empty()) {
+			std::string message = "Validation failed with " + std::to_string(problems.size()) + " problem(s):";
+			for (size_t i = 0; i < problems.size() && i < maxProblems; i++) message += "\n  " + problems[i];
+			throw std::runtime_error(message);
+		}
+
+		Prepare();
+		for (size_t f = 1; f < frames.size(); f++) frames[f].unit->Checked = false;
+		if (frames[0].unit) frames[0].unit->Checked = false;
 	}
 };
 
 class Mux4to16 :public Unit, public circuit {
 public:
+	//输入0为最低位，输入3为最高位
 	Mux4to16() : Unit(4, 16) {}
 
 	void Init() override {
@@ -855,34 +1843,28 @@ public:
 		for (int i = 0; i < 2; i++) {
 			Mux[i] = new Mux3to8;
 			AddUnit(Mux[i]);
-			for (int j = 1; j < 4; j++) {
+			for (int j = 0; j < 3; j++) {
 				SetInput(j, Mux[i], j);
 			}
 		}
 
-		AndGate* andGate[18];
+		//最高位选择低8路或高8路
+		NotGate* notGate = new NotGate();
+		AddUnit(notGate);
+		SetInput(3, notGate, 0);
 
-		for (int i = 0; i < 2; i++) {
+		AndGate* andGate[16];
+		for (int i = 0; i < 16; i++) {
 			andGate[i] = new AndGate();
 			AddUnit(andGate[i]);
-
-			if (i == 0) {
-				NotGate* notGate = new NotGate();
-				AddUnit(notGate);
-				SetInput(0, notGate, 0);
+			if (i < 8) {
 				notGate->Connect(0, andGate[i], 0);
 			}
 			else {
-				SetInput(0, andGate[i], 0);
+				SetInput(3, andGate[i], 0);
 			}
-		}
-
-		for (int i = 0; i < 16; i++) {
-			andGate[i + 2] = new AndGate();
-			AddUnit(andGate[i + 2]);
-			andGate[i / 8]->Connect(0, andGate[i + 2], 0);
-			Mux[i / 8]->Connect(i % 8, andGate[i + 2], 1);
-			SetOutput(i, andGate[i + 2], 0);
+			Mux[i / 8]->Connect(i % 8, andGate[i], 1);
+			SetOutput(i, andGate[i], 0);
 		}
 	}
 
@@ -978,25 +1960,47 @@ public:
 	Rigster() :Unit(11, 8) {}
 	virtual bool isSequential() const { return true; }
 	void Init() override {
-		DFlipFlop* dffs[8];
 		TriStateGate8bit* WriteEnable = new TriStateGate8bit();
 		TriStateGate8bit* ReadEnable = new TriStateGate8bit();
+		//写使能无效时把寄存器输出送回输入，时钟沿保持原值
+		TriStateGate8bit* Hold = new TriStateGate8bit();
+		NotGate* holdEnable = new NotGate();
 		SetInput(10, ReadEnable, 8);//连接读使能到三态门使能输入
 		SetInput(9, WriteEnable, 8);//连接写使能到三态门使能输入
+		SetInput(9, holdEnable, 0);
+		holdEnable->Connect(0, Hold, 8);
 		for (int i = 0; i < 8; i++) {
 			dffs[i] = new DFlipFlop();
-			SetInput(i, WriteEnable, 0);//数据输入
+			SetInput(i, WriteEnable, i);//数据输入
 			WriteEnable->Connect(i, dffs[i], 0);//连接写数据到寄存器输入 
+			Hold->Connect(i, dffs[i], 0);//与写数据线或，同一时刻只有一个有效
 			SetInput(8, dffs[i], 1);//时钟输入
 			dffs[i]->Connect(0, ReadEnable, i);//连接寄存器输出到三态门输入
+			dffs[i]->Connect(0, Hold, i);
 			SetOutput(i, ReadEnable, i);//数据输出
 			AddUnit(dffs[i]);
 		}
+		AddUnit(WriteEnable);
+		AddUnit(ReadEnable);
+		AddUnit(Hold);
+		AddUnit(holdEnable);
 	}
 
 	void Do() override {
 		Excute();
 	}
+
+	//读取触发器中保存的值，不受读使能影响
+	uint8_t Value() const {
+		uint8_t value = 0;
+		for (int i = 0; i < 8; i++) {
+			if (dffs[i] && dffs[i]->Output(0).isOne()) value |= uint8_t(1 << i);
+		}
+		return value;
+	}
+
+private:
+	DFlipFlop* dffs[8] = {};
 };
 
 using MemoryUnit = Rigster;//内存单元，和寄存器功能一样，只是名字不同，便于理解
@@ -1012,25 +2016,35 @@ public:
 	virtual bool isSequential() const { return true; }
 
 	void Init() override {
-		MemoryUnit* memUnits[8];
 		Mux3to8* mux = new Mux3to8();//地址选择器
+		AddUnit(mux);
 		SetInput(11, mux, 0);
 		SetInput(12, mux, 1);
 		SetInput(13, mux, 2);
+		//各单元的三态输出在总线上线或，总线在下一周期给出读出的数据
+		Bus8bit* bus = new Bus8bit();
+		AddUnit(bus);
+		for (int j = 0; j < 8; j++) {
+			SetOutput(j, bus, j);//数据输出
+		}
 		for (int i = 0; i < 8; i++) {
 			memUnits[i] = new MemoryUnit();
 
 			for (int j = 0; j < 8; j++) {
 				SetInput(j, memUnits[i], j);//数据输入
-				SetOutput(j, memUnits[i], j);//数据输出
+				memUnits[i]->Connect(j, bus, j);
 			}
-			//确保选择对应的内存地址
-			mux->Connect(i, memUnits[i], 9);//连接地址选择到每个内存单元的写使能输入
-			mux->Connect(i, memUnits[i], 10);//连接地址选择到每个内存单元的读使能输入
-
-			//读写使能输入
-			SetInput(9, memUnits[i], 9);//写控制输入
-			SetInput(10, memUnits[i], 10);//读控制输入
+			//确保选择对应的内存地址：地址选择与读写控制相与后作为单元的读写使能
+			AndGate* writeSelect = new AndGate();
+			AndGate* readSelect = new AndGate();
+			AddUnit(writeSelect);
+			AddUnit(readSelect);
+			mux->Connect(i, writeSelect, 0);
+			SetInput(9, writeSelect, 1);//写控制输入
+			mux->Connect(i, readSelect, 0);
+			SetInput(10, readSelect, 1);//读控制输入
+			writeSelect->Connect(0, memUnits[i], 9);//连接到内存单元的写使能输入
+			readSelect->Connect(0, memUnits[i], 10);//连接到内存单元的读使能输入
 
 			SetInput(8, memUnits[i], 8);//时钟输入
 			AddUnit(memUnits[i]);
@@ -1040,6 +2054,215 @@ public:
 	void Do() override {
 		Excute();
 	}
+
+	//读取某个单元中保存的值
+	uint8_t Value(size_t address) const {
+		CheckRange(address, 1, 8);
+		return memUnits[address] ? memUnits[address]->Value() : 0;
+	}
+
+private:
+	MemoryUnit* memUnits[8] = {};
+};
+
+//多端口寄存器堆，寄存器数量、位宽、读写端口数可配置
+//输入：W组写数据(每组width位), 1位时钟, W位写使能, R位读使能, W组写地址, R组读地址
+//输出：R组读数据(每组width位)，读使能无效时为高阻
+//与 Rigster 相同，时钟上升沿写入，读出的是写入前的值；多个写端口写同一寄存器时编号大的端口优先
+class RegisterFile : public Unit, public circuit {
+private:
+	size_t Count;
+	size_t Width;
+	size_t ReadPorts;
+	size_t WritePorts;
+	size_t AddrBits;
+	bool GateLevel;
+	std::vector<uint64_t> regs;//按字存储
+	bool lastClock = false;
+	std::vector<DFlipFlop*> cells;//门级模式下的存储位，cells[r * Width + b]
+
+	static size_t BitsFor(size_t count) {
+		size_t bits = 0;
+		while ((size_t(1) << bits) < count) bits++;
+		return bits;
+	}
+
+	size_t ClockPin() const { return WritePorts * Width; }
+	size_t WriteEnablePin(size_t port) const { return ClockPin() + 1 + port; }
+	size_t ReadEnablePin(size_t port) const { return ClockPin() + 1 + WritePorts + port; }
+	size_t WriteAddrPin(size_t port) const { return ClockPin() + 1 + WritePorts + ReadPorts + port * AddrBits; }
+	size_t ReadAddrPin(size_t port) const { return WriteAddrPin(WritePorts) + port * AddrBits; }
+
+	size_t Address(size_t firstPin) {
+		size_t addr = 0;
+		for (size_t i = 0; i < AddrBits; i++) {
+			if (Input(firstPin + i).isOne()) addr |= size_t(1) << i;
+		}
+		return addr;
+	}
+
+	//地址比较：返回 (addr == index) & enable 的输出单元
+	Unit* Select(NotGateNBit* inverted, size_t addrPin, size_t enablePin, size_t index) {
+		AndGateNBit_nInput* match = new AndGateNBit_nInput(1, int(AddrBits + 1));
+		AddUnit(match);
+		for (size_t i = 0; i < AddrBits; i++) {
+			if ((index >> i) & 1) SetInput(addrPin + i, match, i);
+			else inverted->Connect(i, match, i);
+		}
+		SetInput(enablePin, match, AddrBits);
+		return match;
+	}
+
+	NotGateNBit* InvertAddress(size_t addrPin) {
+		NotGateNBit* inverted = new NotGateNBit(int(AddrBits));
+		AddUnit(inverted);
+		for (size_t i = 0; i < AddrBits; i++) SetInput(addrPin + i, inverted, i);
+		return inverted;
+	}
+
+public:
+	RegisterFile(size_t count, size_t width, size_t readPorts = 2, size_t writePorts = 1, bool gateLevel = false)
+		: Unit(writePorts* width + 1 + writePorts + readPorts + (writePorts + readPorts) * BitsFor(count), readPorts* width),
+		Count(count), Width(width), ReadPorts(readPorts), WritePorts(writePorts),
+		AddrBits(BitsFor(count)), GateLevel(gateLevel), regs(count, 0) {
+		if (width == 0 || width > 64) {
+			throw std::runtime_error("RegisterFile width must be 1..64");
+		}
+	}
+
+	virtual bool isSequential() const { return true; }
+	bool IsStructural() const override { return GateLevel; }
+	bool CanFloat() const override { return true; }
+
+	size_t ReadPortCount() const { return ReadPorts; }
+	size_t WritePortCount() const { return WritePorts; }
+	size_t AddressBits() const { return AddrBits; }
+
+	//读取寄存器当前值，门级模式下从触发器读出
+	uint64_t Read(size_t index) {
+		if (!GateLevel) return regs[index];
+		uint64_t value = 0;
+		for (size_t b = 0; b < Width; b++) {
+			if (cells[index * Width + b]->Output(0).isOne()) value |= uint64_t(1) << b;
+		}
+		return value;
+	}
+
+	//门级展开，只在 gateLevel 时使用，用于与字级模型对照验证
+	void Init() override {
+		if (!GateLevel) return;
+		cells.resize(Count * Width);
+		for (size_t i = 0; i < cells.size(); i++) {
+			cells[i] = new DFlipFlop();
+			SetInput(ClockPin(), cells[i], 1);//时钟输入
+			AddUnit(cells[i]);
+		}
+
+		//写端口：每个寄存器选择优先级最高的有效写端口，否则保持原值
+		std::vector<NotGateNBit*> writeAddr(WritePorts);
+		for (size_t w = 0; w < WritePorts; w++) writeAddr[w] = InvertAddress(WriteAddrPin(w));
+		for (size_t r = 0; r < Count; r++) {
+			OrGateNBit_nInput* dataIn = new OrGateNBit_nInput(int(Width), int(WritePorts + 1));
+			AddUnit(dataIn);
+			Unit* later = nullptr;//编号更大的端口是否已选中该寄存器
+			for (size_t w = WritePorts; w-- > 0;) {
+				Unit* select = Select(writeAddr[w], WriteAddrPin(w), WriteEnablePin(w), r);
+				Unit* effective = select;
+				if (later) {
+					NotGate* notLater = new NotGate();
+					AndGate* gate = new AndGate();
+					OrGate* any = new OrGate();
+					AddUnit(notLater).AddUnit(gate).AddUnit(any);
+					later->Connect(0, notLater, 0);
+					select->Connect(0, gate, 0);
+					notLater->Connect(0, gate, 1);
+					later->Connect(0, any, 0);
+					select->Connect(0, any, 1);
+					effective = gate;
+					later = any;
+				}
+				else {
+					later = select;
+				}
+				AndGateNbit* data = new AndGateNbit(int(Width));
+				AddUnit(data);
+				for (size_t b = 0; b < Width; b++) {
+					SetInput(w * Width + b, data, b);
+					effective->Connect(0, data, b + Width);
+					data->Connect(b, dataIn, b + w * Width);
+				}
+			}
+			NotGate* hold = new NotGate();
+			AndGateNbit* keep = new AndGateNbit(int(Width));
+			AddUnit(hold).AddUnit(keep);
+			later->Connect(0, hold, 0);
+			for (size_t b = 0; b < Width; b++) {
+				cells[r * Width + b]->Connect(0, keep, b);
+				hold->Connect(0, keep, b + Width);
+				keep->Connect(b, dataIn, b + WritePorts * Width);
+				dataIn->Connect(b, cells[r * Width + b], 0);
+			}
+		}
+
+		//读端口：按地址选择寄存器，经三态门输出
+		for (size_t p = 0; p < ReadPorts; p++) {
+			NotGateNBit* readAddr = InvertAddress(ReadAddrPin(p));
+			OrGateNBit_nInput* dataOut = new OrGateNBit_nInput(int(Width), int(Count));
+			AddUnit(dataOut);
+			for (size_t r = 0; r < Count; r++) {
+				Unit* select = Select(readAddr, ReadAddrPin(p), ReadEnablePin(p), r);
+				AndGateNbit* data = new AndGateNbit(int(Width));
+				AddUnit(data);
+				for (size_t b = 0; b < Width; b++) {
+					cells[r * Width + b]->Connect(0, data, b);
+					select->Connect(0, data, b + Width);
+					data->Connect(b, dataOut, b + r * Width);
+				}
+			}
+			for (size_t b = 0; b < Width; b++) {
+				TriStateGate* gate = new TriStateGate();
+				AddUnit(gate);
+				dataOut->Connect(b, gate, 0);
+				SetInput(ReadEnablePin(p), gate, 1);
+				SetOutput(p * Width + b, gate, 0);
+			}
+		}
+	}
+
+	void Do() override {
+		if (GateLevel) {
+			Excute();
+			return;
+		}
+		//先读后写
+		for (size_t p = 0; p < ReadPorts; p++) {
+			if (Input(ReadEnablePin(p)).isOne()) {
+				size_t addr = Address(ReadAddrPin(p));
+				uint64_t value = addr < Count ? regs[addr] : 0;
+				for (size_t b = 0; b < Width; b++) {
+					Output(p * Width + b) = Bit(((value >> b) & 1) != 0);
+				}
+			}
+			else {
+				for (size_t b = 0; b < Width; b++) Output(p * Width + b) = -1;//高阻
+			}
+		}
+
+		bool clk = Input(ClockPin()).isOne();
+		if (!lastClock && clk) {// 上升沿写入
+			for (size_t w = 0; w < WritePorts; w++) {
+				if (!Input(WriteEnablePin(w)).isOne()) continue;
+				size_t addr = Address(WriteAddrPin(w));
+				if (addr >= Count) continue;
+				uint64_t value = 0;
+				for (size_t b = 0; b < Width; b++) {
+					if (Input(w * Width + b).isOne()) value |= uint64_t(1) << b;
+				}
+				regs[addr] = value;
+			}
+		}
+		lastClock = clk;
+	}
 };
 
 class Adder8bit : public Unit, public circuit {
@@ -1105,6 +2328,335 @@ public:
 	}
 };
 
+//门级数据通路的公共部分：把信号记为 {子单元, 输出下标}，统一连线，再在上面搭加法器、选择器
+//注意 SetOutput 会替换子单元的输出位，绑定整体输出要在该输出接到其他单元之前完成
+class GateBuilder : public Unit, public circuit {
+protected:
+	struct Wire {
+		Unit* unit;   //nullptr 表示本单元的输入
+		size_t index;
+	};
+
+	GateBuilder(size_t inputCount, size_t outputCount) : Unit(inputCount, outputCount) {}
+
+	static size_t BitsFor(size_t count) {
+		size_t bits = 0;
+		while ((size_t(1) << bits) < count) bits++;
+		return bits;
+	}
+
+	static Wire Pin(size_t input) { return { nullptr, input }; }
+
+	Wire Zero() {
+		if (!zero) {
+			zero = new PullDown();
+			AddUnit(zero);
+		}
+		return { zero, 0 };
+	}
+
+	Wire One() {
+		if (!one) {
+			one = new PullUp();
+			AddUnit(one);
+		}
+		return { one, 0 };
+	}
+
+	void Drive(Wire w, Unit* to, size_t pin) {
+		if (w.unit) w.unit->Connect(w.index, to, pin);
+		else SetInput(w.index, to, pin);
+	}
+
+	void Bind(size_t output, Wire w) {
+		if (!w.unit) throw std::runtime_error("Cannot bind an input directly to an output");
+		SetOutput(output, w.unit, w.index);
+	}
+
+	template<class Gate>
+	Wire Gate2(Wire a, Wire b) {
+		Gate* gate = new Gate();
+		AddUnit(gate);
+		Drive(a, gate, 0);
+		Drive(b, gate, 1);
+		return { gate, 0 };
+	}
+
+	Wire And(Wire a, Wire b) { return Gate2<AndGate>(a, b); }
+	Wire Or(Wire a, Wire b) { return Gate2<OrGate>(a, b); }
+	Wire Xor(Wire a, Wire b) { return Gate2<XorGate>(a, b); }
+
+	Wire Not(Wire a) {
+		NotGate* gate = new NotGate();
+		AddUnit(gate);
+		Drive(a, gate, 0);
+		return { gate, 0 };
+	}
+
+	//sel 为 1 选 b，否则选 a；notSel 由调用者共用
+	Wire Mux(Wire sel, Wire notSel, Wire a, Wire b) {
+		return Or(And(a, notSel), And(b, sel));
+	}
+
+	//半加器、全加器：返回 {和, 进位}
+	std::pair<Wire, Wire> HalfAdd(Wire a, Wire b) {
+		return { Xor(a, b), And(a, b) };
+	}
+
+	std::pair<Wire, Wire> FullAdd(Wire a, Wire b, Wire c) {
+		Wire t = Xor(a, b);
+		return { Xor(t, c), Or(And(a, b), And(t, c)) };
+	}
+
+	//Sklansky 并行前缀加法器，深度 O(log n)：返回 n 位和，最后一位是进位输出
+	//第0个元素是进位输入（只有生成信号），第 i+1 个元素是第 i 位的 {生成, 传播}
+	std::vector<Wire> PrefixAdd(const std::vector<Wire>& a, const std::vector<Wire>& b, Wire cin) {
+		size_t n = a.size();
+		std::vector<Wire> p(n), g(n + 1), pp(n + 1);
+		std::vector<bool> hasP(n + 1, true);
+		g[0] = cin;
+		hasP[0] = false;
+		for (size_t i = 0; i < n; i++) {
+			p[i] = Xor(a[i], b[i]);
+			g[i + 1] = And(a[i], b[i]);
+			pp[i + 1] = p[i];
+		}
+		for (size_t d = 1; d < n + 1; d <<= 1) {
+			bool more = (d << 1) < n + 1;//之后还有层级才需要组的传播信号
+			for (size_t k = d; k <= n; k++) {
+				if (!(k & d)) continue;
+				size_t j = (k & ~((d << 1) - 1)) + d - 1;//左半块的最后一个元素
+				if (hasP[k]) g[k] = Or(g[k], And(pp[k], g[j]));
+				if (more && hasP[k]) {
+					if (hasP[j]) pp[k] = And(pp[k], pp[j]);
+					else hasP[k] = false;
+				}
+				else hasP[k] = hasP[k] && hasP[j];
+			}
+		}
+		std::vector<Wire> sum(n + 1);
+		for (size_t i = 0; i < n; i++) sum[i] = Xor(p[i], g[i]);
+		sum[n] = g[n];
+		return sum;
+	}
+
+	static uint64_t Mask(size_t bits) {
+		return bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+	}
+
+	uint64_t Word(size_t firstPin, size_t bits) {
+		uint64_t value = 0;
+		for (size_t i = 0; i < bits; i++) {
+			if (Input(firstPin + i).isOne()) value |= uint64_t(1) << i;
+		}
+		return value;
+	}
+
+	void Store(size_t firstPin, size_t bits, uint64_t value) {
+		for (size_t i = 0; i < bits; i++) Output(firstPin + i) = Bit(((value >> i) & 1) != 0);
+	}
+
+private:
+	Unit* zero = nullptr;
+	Unit* one = nullptr;
+};
+
+//Dadda 树乘法器
+//输入：Nbit被乘数 Nbit乘数 -> 2*Nbit乘积
+//门级：n*n 个与门产生部分积，按 Dadda 高度序列 2,3,4,6,9,... 用全加器/半加器逐级压缩到两行，
+//再用前缀加法器求和，总深度 O(log n)；行为级（gateLevel 为 false）直接做整数乘法，Nbit 不超过64
+class MultiplierNbit : public GateBuilder {
+private:
+	size_t Nbit;
+	bool GateLevel;
+
+	//64x64 -> 128 位乘法，拆成32位的四个部分积
+	static void Multiply(uint64_t a, uint64_t b, uint64_t& lo, uint64_t& hi) {
+		uint64_t a0 = a & 0xffffffff, a1 = a >> 32, b0 = b & 0xffffffff, b1 = b >> 32;
+		uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+		uint64_t mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+		lo = (p00 & 0xffffffff) | (mid << 32);
+		hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+	}
+
+public:
+	MultiplierNbit(int n, bool gateLevel = true) : GateBuilder(2 * n, 2 * n), Nbit(n), GateLevel(gateLevel) {
+		if (!gateLevel && n > 64) throw std::out_of_range("Behavioral multiplier supports at most 64 bits");
+	}
+
+	bool IsStructural() const override { return GateLevel; }
+
+	void Init() override {
+		if (!GateLevel) return;
+		size_t width = 2 * Nbit;
+		//按权重分列的部分积
+		std::vector<std::vector<Wire>> columns(width + 1);
+		size_t height = 0;
+		for (size_t i = 0; i < Nbit; i++) {
+			for (size_t j = 0; j < Nbit; j++) {
+				columns[i + j].push_back(And(Pin(j), Pin(Nbit + i)));
+				height = std::max(height, columns[i + j].size());
+			}
+		}
+		std::vector<size_t> targets{ 2 };
+		while (targets.back() < height) targets.push_back(targets.back() * 3 / 2);
+		targets.pop_back();
+		//从大到小逐级压缩，本级产生的进位计入下一列的高度，但只在下一级再参与压缩
+		for (size_t t = targets.size(); t-- > 0;) {
+			size_t target = targets[t];
+			std::vector<std::vector<Wire>> next(width + 1);
+			std::vector<std::vector<Wire>> carries(width + 2);
+			for (size_t c = 0; c < width; c++) {
+				std::vector<Wire>& bits = columns[c];
+				bits.insert(bits.end(), carries[c].begin(), carries[c].end());
+				size_t h = bits.size(), used = 0;
+				while (h > target) {
+					if (h >= target + 2) {
+						auto [s, co] = FullAdd(bits[used], bits[used + 1], bits[used + 2]);
+						used += 3;
+						h -= 2;
+						next[c].push_back(s);
+						carries[c + 1].push_back(co);
+					}
+					else {
+						auto [s, co] = HalfAdd(bits[used], bits[used + 1]);
+						used += 2;
+						h -= 1;
+						next[c].push_back(s);
+						carries[c + 1].push_back(co);
+					}
+				}
+				next[c].insert(next[c].end(), bits.begin() + used, bits.end());
+			}
+			columns.swap(next);
+		}
+		//剩下两行，用前缀加法器求和（最高位的进位超出乘积宽度，丢弃）
+		std::vector<Wire> a(width), b(width);
+		for (size_t c = 0; c < width; c++) {
+			a[c] = columns[c].size() > 0 ? columns[c][0] : Zero();
+			b[c] = columns[c].size() > 1 ? columns[c][1] : Zero();
+		}
+		std::vector<Wire> sum = PrefixAdd(a, b, Zero());
+		for (size_t c = 0; c < width; c++) Bind(c, sum[c]);
+	}
+
+	void Do() override {
+		if (GateLevel) {
+			Excute();
+			return;
+		}
+		uint64_t lo, hi;
+		Multiply(Word(0, Nbit), Word(Nbit, Nbit), lo, hi);
+		Store(0, std::min<size_t>(Nbit * 2, 64), lo);
+		if (Nbit * 2 > 64) Store(64, Nbit * 2 - 64, hi);
+	}
+};
+
+//恢复余数阵列除法器
+//输入：Nbit被除数 Nbit除数 -> Nbit商 Nbit余数
+//门级：每行把部分余数左移一位并移入被除数的下一位，用前缀减法器试减除数，
+//没有借位则商为1并保留差，否则恢复原值；n 行、每行深度 O(log n)
+//除数为0时与门级结构一致：商全为1，余数等于被除数
+class DividerNbit : public GateBuilder {
+private:
+	size_t Nbit;
+	bool GateLevel;
+
+public:
+	DividerNbit(int n, bool gateLevel = true) : GateBuilder(2 * n, 2 * n), Nbit(n), GateLevel(gateLevel) {
+		if (!gateLevel && n > 64) throw std::out_of_range("Behavioral divider supports at most 64 bits");
+	}
+
+	bool IsStructural() const override { return GateLevel; }
+
+	void Init() override {
+		if (!GateLevel) return;
+		//除数取反并扩展一位（扩展位为0，取反后为1），减法 = 加反码 + 1
+		std::vector<Wire> divisor(Nbit + 1);
+		for (size_t i = 0; i < Nbit; i++) divisor[i] = Not(Pin(Nbit + i));
+		divisor[Nbit] = One();
+
+		std::vector<Wire> remainder(Nbit, Zero());
+		for (size_t row = Nbit; row-- > 0;) {
+			std::vector<Wire> shifted(Nbit + 1);
+			shifted[0] = Pin(row);
+			for (size_t i = 0; i < Nbit; i++) shifted[i + 1] = remainder[i];
+			std::vector<Wire> diff = PrefixAdd(shifted, divisor, One());
+			Wire q = diff[Nbit + 1];//进位为1表示够减
+			Bind(row, q);
+			Wire notQ = Not(q);
+			for (size_t i = 0; i < Nbit; i++) {
+				remainder[i] = Mux(q, notQ, shifted[i], diff[i]);
+			}
+		}
+		for (size_t i = 0; i < Nbit; i++) Bind(Nbit + i, remainder[i]);
+	}
+
+	void Do() override {
+		if (GateLevel) {
+			Excute();
+			return;
+		}
+		uint64_t a = Word(0, Nbit), b = Word(Nbit, Nbit);
+		uint64_t q = b ? a / b : Mask(Nbit);
+		uint64_t r = b ? a % b : a;
+		Store(0, Nbit, q);
+		Store(Nbit, Nbit, r);
+	}
+};
+
+//对数桶形移位器（逻辑移位，移入0）
+//输入：Nbit数据 log2(Nbit)位移位量 1位方向(0左移 1右移) -> Nbit结果
+//门级：右移时先把数据倒序，经过 log2(Nbit) 级 2选1 左移 1、2、4... 位，再倒序回来，深度 O(log n)
+class BarrelShifterNbit : public GateBuilder {
+private:
+	size_t Nbit;
+	size_t AmountBits;
+	bool GateLevel;
+
+public:
+	BarrelShifterNbit(int n, bool gateLevel = true)
+		: GateBuilder(n + BitsFor(n) + 1, n), Nbit(n), AmountBits(BitsFor(n)), GateLevel(gateLevel) {
+		if (!gateLevel && n > 64) throw std::out_of_range("Behavioral shifter supports at most 64 bits");
+	}
+
+	size_t AmountPin() const { return Nbit; }
+	size_t DirectionPin() const { return Nbit + AmountBits; }
+
+	bool IsStructural() const override { return GateLevel; }
+
+	void Init() override {
+		if (!GateLevel) return;
+		Wire right = Pin(DirectionPin());
+		Wire left = Not(right);
+		std::vector<Wire> data(Nbit);
+		for (size_t i = 0; i < Nbit; i++) data[i] = Mux(right, left, Pin(i), Pin(Nbit - 1 - i));
+		for (size_t s = 0; s < AmountBits; s++) {
+			size_t distance = size_t(1) << s;
+			Wire sel = Pin(AmountPin() + s);
+			Wire keep = Not(sel);
+			std::vector<Wire> shifted(Nbit);
+			for (size_t i = 0; i < Nbit; i++) {
+				shifted[i] = i >= distance ? Mux(sel, keep, data[i], data[i - distance]) : And(data[i], keep);
+			}
+			data.swap(shifted);
+		}
+		for (size_t i = 0; i < Nbit; i++) Bind(i, Mux(right, left, data[i], data[Nbit - 1 - i]));
+	}
+
+	void Do() override {
+		if (GateLevel) {
+			Excute();
+			return;
+		}
+		uint64_t value = Word(0, Nbit);
+		uint64_t amount = Word(AmountPin(), AmountBits);
+		if (amount >= Nbit) value = 0;
+		else value = Input(DirectionPin()).isOne() ? value >> amount : (value << amount) & Mask(Nbit);
+		Store(0, Nbit, value);
+	}
+};
+
 class ALU8bit :public Unit, public circuit {
 public:
 	//8bitALU单元
@@ -1252,9 +2804,12 @@ public:
 class ALU : public Unit, public circuit {
 private:
 	int Nbit;
+	bool GateLevel;
 public:
-	//2*n输入 1bit进位信息 3bit操作码(最多8个操作，加减，与或非) -> n bit输出 1bit进位输出 , 5bit标记位（占位）
-	ALU(int n) : Unit(2 * n + 1 + 3, n + 6), Nbit(n) {}
+	//2*n输入 1bit进位信息 3bit操作码(8个操作：加 减 与 或 非 乘 除 移位) -> n bit输出 1bit进位输出 , 5bit标记位（占位）
+	//乘法取乘积低n位，除法输出商，移位用B的低位作为移位量、进位输入选择方向（0左移 1右移）
+	//gateLevel 为 false 时乘法器、除法器、移位器使用行为级实现，其余部分仍是门级
+	ALU(int n, bool gateLevel = true) : Unit(2 * n + 1 + 3, n + 6), Nbit(n), GateLevel(gateLevel) {}
 	void Init() override {
 		//位数匹配的加法器
 		AdderNbit* adder = new AdderNbit(Nbit);
@@ -1267,22 +2822,16 @@ public:
 		//输入或门
 		OrGateNBit_nInput* OutputGate = new OrGateNBit_nInput(Nbit, 8);//8输入或门，连接8个操作的输出到结果输出
 		AddUnit(OutputGate);
-		for (size_t index = 0; index < Nbit; index++) {
-			SetOutput(index, OutputGate, index);//连接结果输出到8输入与门的输出
-		}
+		SetOutputBus(0, OutputGate->Bus(0, Nbit));//连接结果输出到8输入与门的输出
 
 
 		//连接操作码到解码器
-		for (size_t index = 0; index < 3; index++) {
-			SetInput(2 * Nbit + 1 + index, decoder, index);
-		}
+		SetInputBus(2 * Nbit + 1, decoder->Bus(0, 3));
 
 		{
 			//加法器处理
 			//输入A ,加减相同
-			for (size_t index = 0; index < Nbit; index++) {
-				SetInput(index, adder, index);//按位连接输入A
-			}
+			SetInputBus(0, adder->Bus(0, Nbit));//按位连接输入A
 
 			//输入B,加法直接输入，减法取反输入，进位输入1
 			//3个8位与门来实现输入的选择
@@ -1386,27 +2935,344 @@ public:
 			}
 			//非操作只使用输入A，输入B不连接
 		}
+
+		//乘法，只取乘积的低n位
+		{
+			MultiplierNbit* multiplier = new MultiplierNbit(Nbit, GateLevel);
+			AddUnit(multiplier);
+			SetInputBus(0, multiplier->Bus(0, 2 * Nbit));
+			AndGateNbit* andGateOp = new AndGateNbit(Nbit);
+			AddUnit(andGateOp);
+			for (int i = 0; i < Nbit; ++i) {
+				multiplier->Connect(i, andGateOp, i);
+				decoder->Connect(5, andGateOp, i + Nbit);
+				andGateOp->Connect(i, OutputGate, i + 5 * Nbit);
+			}
+		}
+
+		//除法，输出商
+		{
+			DividerNbit* divider = new DividerNbit(Nbit, GateLevel);
+			AddUnit(divider);
+			SetInputBus(0, divider->Bus(0, 2 * Nbit));
+			AndGateNbit* andGateOp = new AndGateNbit(Nbit);
+			AddUnit(andGateOp);
+			for (int i = 0; i < Nbit; ++i) {
+				divider->Connect(i, andGateOp, i);
+				decoder->Connect(6, andGateOp, i + Nbit);
+				andGateOp->Connect(i, OutputGate, i + 6 * Nbit);
+			}
+		}
+
+		//移位，A为数据，B的低位为移位量，进位输入为方向
+		{
+			BarrelShifterNbit* shifter = new BarrelShifterNbit(Nbit, GateLevel);
+			AddUnit(shifter);
+			SetInputBus(0, shifter->Bus(0, Nbit));
+			SetInputBus(Nbit, shifter->Bus(shifter->AmountPin(), shifter->DirectionPin() - shifter->AmountPin()));
+			SetInput(2 * Nbit, shifter, shifter->DirectionPin());
+			AndGateNbit* andGateOp = new AndGateNbit(Nbit);
+			AddUnit(andGateOp);
+			for (int i = 0; i < Nbit; ++i) {
+				shifter->Connect(i, andGateOp, i);
+				decoder->Connect(7, andGateOp, i + Nbit);
+				andGateOp->Connect(i, OutputGate, i + 7 * Nbit);
+			}
+		}
 	}
 
 	void Do() override {
 		Excute();
 	}
 };
-//一个8位总线单元
-class Bus8bit : public Unit {
+
+//指令存储（ROM）：8位地址 -> 16位指令，行为级单元；超出程序长度的地址读出 fill
+class InstructionRom : public Unit {
+private:
+	std::vector<uint16_t> words;
+	uint16_t fill;
 public:
-	Bus8bit() :Unit(8, 8) {}
+	InstructionRom(std::vector<uint16_t> program = {}, uint16_t fillWord = 0)
+		: Unit(8, 16), words(std::move(program)), fill(fillWord) {}
+
+	void Load(std::vector<uint16_t> program) {
+		words = std::move(program);
+	}
+
+	bool IsStateless() const override { return true; }
 
 	void Do() override {
-		for (int i = 0; i < 8; ++i) {
-			Output(i) = Input(i);
+		size_t address = 0;
+		for (int i = 0; i < 8; i++) {
+			if (Input(i).isOne()) address |= size_t(1) << i;
+		}
+		uint16_t word = address < words.size() ? words[address] : fill;
+		for (int i = 0; i < 16; i++) {
+			Output(i) = (word >> i) & 1;
 		}
 	}
 };
 
-class CPU {
+//8位CPU：程序计数器、指令存储、4个通用寄存器、ALU、数据存储
+//16位指令：[15:12]操作码 [11:10]rd [9:8]rs [7:0]立即数/地址
+//整个 CPU 是一个结构级线路：PC 为 Rigster，取指经 InstructionRom，Mux4to16 译码，RegisterFile 两读一写，
+//ALU 运算，MemoryBlock 存数据，写回数据和下一条 PC 各经三态门汇到一条 Bus8bit 上；可以放进其他线路，也可以编译给各引擎执行
+//内部时钟二分频后作为系统时钟，每条指令 CyclesPerInstruction 个周期：PC 和读端口各要一个周期给出新值，
+//存储器读出要两个周期，在下一个上升沿写回寄存器和 PC
+//gateLevel 为 false 时寄存器堆和 ALU 的乘除移位使用行为级实现，其余部分仍是门级
+class CPU : public Unit, public circuit {
+public:
+	enum Opcode : uint8_t {
+		NOP = 0,
+		ADD,  // rd = rd + rs
+		SUB,  // rd = rd - rs
+		AND,  // rd = rd & rs
+		OR,   // rd = rd | rs
+		NOT,  // rd = ~rd
+		LDI,  // rd = imm
+		LD,   // rd = mem[imm]
+		ST,   // mem[imm] = rs
+		JMP,  // pc = imm
+		JZ,   // if (rd == 0) pc = imm
+		JNZ,  // if (rd != 0) pc = imm
+		MOV,  // rd = rs
+		HLT = 15,
+	};
+
+	static uint16_t Encode(Opcode op, int rd = 0, int rs = 0, int imm = 0) {
+		return uint16_t((op << 12) | ((rd & 3) << 10) | ((rs & 3) << 8) | (imm & 0xFF));
+	}
+
+	static constexpr size_t CyclesPerInstruction = 4;
+
+private:
+	bool gateLevel;
+	size_t instructions = 0;
+
+	InstructionRom* rom;
+	Rigster* pc = nullptr;
+	RegisterFile* regFile = nullptr;
+	MemoryBlock* dataMemory = nullptr;
+
+	//多个译码线相或，输出1位
+	Unit* AnyOf(Mux4to16* decoder, std::initializer_list<int> lines) {
+		OrGateNBit_nInput* any = new OrGateNBit_nInput(1, int(lines.size()));
+		AddUnit(any);
+		size_t k = 0;
+		for (int line : lines) decoder->Connect(line, any, k++);
+		return any;
+	}
+
+	//8位数据经三态门接到总线，enable 为使能信号的 {单元, 输出下标}
+	void Drive(Bus8bit* bus, Unit* source, size_t first, Unit* enable, size_t enableIndex) {
+		TriStateGate8bit* gate = new TriStateGate8bit();
+		AddUnit(gate);
+		source->ConnectBus(first, gate->Bus(0, 8));
+		enable->Connect(enableIndex, gate, 8);
+		gate->ConnectBus(0, bus->Bus(0, 8));
+	}
+
 public:
-	CPU() {
+	//输出：8位 PC，1位停机（当前指令为 HLT）
+	CPU(std::vector<uint16_t> program = {}, bool gateLevel = true)
+		: Unit(0, 9), gateLevel(gateLevel), rom(new InstructionRom(std::move(program), Encode(HLT))) {}
+
+	bool IsGateLevel() const { return gateLevel; }
+
+	//更换程序，应在开始执行之前调用
+	void Load(const std::vector<uint16_t>& code) {
+		rom->Load(code);
+	}
+
+	void Init() override {
+		//时钟二分频：上升沿之间隔 CyclesPerInstruction 个周期
+		Clock* clock = new Clock();
+		DFlipFlop* divider = new DFlipFlop();
+		NotGate* toggle = new NotGate();
+		NotGate* sysClock = new NotGate();
+		PullUp* one = new PullUp();
+		PullDown* zero = new PullDown();
+		AddUnit(clock).AddUnit(divider).AddUnit(toggle).AddUnit(sysClock).AddUnit(one).AddUnit(zero);
+		clock->Connect(0, divider, 1);
+		divider->Connect(0, toggle, 0);
+		toggle->Connect(0, divider, 0);
+		divider->Connect(0, sysClock, 0);
+
+		//取指和译码，整体输出在子单元连到其他单元之前绑定
+		pc = new Rigster();
+		Mux4to16* decoder = new Mux4to16();
+		SetOutputBus(0, pc->Bus(0, 8));
+		SetOutput(8, decoder, HLT);
+		AddUnit(pc).AddUnit(rom).AddUnit(decoder);
+		pc->ConnectBus(0, rom->Bus(0, 8));
+		sysClock->Connect(0, pc, 8);
+		one->Connect(0, pc, 10);
+		rom->ConnectBus(12, decoder->Bus(0, 4));
+
+		//寄存器堆：写数据 0-7，时钟 8，写使能 9，读使能 10-11，写地址 12-13，读地址 14-15（rd）、16-17（rs）
+		regFile = new RegisterFile(4, 8, 2, 1, gateLevel);
+		AddUnit(regFile);
+		sysClock->Connect(0, regFile, 8);
+		one->Connect(0, regFile, 10);
+		one->Connect(0, regFile, 11);
+		rom->ConnectBus(10, regFile->Bus(12, 2));
+		rom->ConnectBus(10, regFile->Bus(14, 2));
+		rom->ConnectBus(8, regFile->Bus(16, 2));
+		Unit* write = AnyOf(decoder, { ADD, SUB, AND, OR, NOT, LDI, LD, MOV });
+		write->Connect(0, regFile, 9);
+
+		//ALU：A 为 rd，B 为 rs，操作码为指令操作码减1（0加 1减 2与 3或 4非）
+		ALU* alu = new ALU(8, gateLevel);
+		AddUnit(alu);
+		regFile->ConnectBus(0, alu->Bus(0, 8));
+		regFile->ConnectBus(8, alu->Bus(8, 8));
+		zero->Connect(0, alu, 16);
+		AnyOf(decoder, { SUB, OR })->Connect(0, alu, 17);
+		AnyOf(decoder, { AND, OR })->Connect(0, alu, 18);
+		decoder->Connect(NOT, alu, 19);
+
+		//数据存储：写数据为 rs，地址为立即数低3位
+		dataMemory = new MemoryBlock();
+		AddUnit(dataMemory);
+		regFile->ConnectBus(8, dataMemory->Bus(0, 8));
+		sysClock->Connect(0, dataMemory, 8);
+		decoder->Connect(ST, dataMemory, 9);
+		decoder->Connect(LD, dataMemory, 10);
+		rom->ConnectBus(0, dataMemory->Bus(11, 3));
+
+		//写回：ALU 结果、立即数、存储器读出、rs 之一经总线写入寄存器堆
+		Bus8bit* writeBack = new Bus8bit();
+		AddUnit(writeBack);
+		Drive(writeBack, alu, 0, AnyOf(decoder, { ADD, SUB, AND, OR, NOT }), 0);
+		Drive(writeBack, rom, 0, decoder, LDI);
+		Drive(writeBack, dataMemory, 0, decoder, LD);
+		Drive(writeBack, regFile, 8, decoder, MOV);
+		writeBack->ConnectBus(0, regFile->Bus(0, 8));
+
+		//下一条 PC：跳转时为立即数，否则为 PC+1；HLT 时不写 PC
+		AdderNbit* incrementer = new AdderNbit(8);
+		AddUnit(incrementer);
+		pc->ConnectBus(0, incrementer->Bus(0, 8));
+		for (int i = 0; i < 8; i++) zero->Connect(0, incrementer, 8 + i);
+		one->Connect(0, incrementer, 16);
+		OrGateNBit_nInput* nonZero = new OrGateNBit_nInput(1, 8);
+		NotGate* isZero = new NotGate();
+		AndGate* jz = new AndGate();
+		AndGate* jnz = new AndGate();
+		OrGateNBit_nInput* jump = new OrGateNBit_nInput(1, 3);
+		NotGate* sequential = new NotGate();
+		NotGate* running = new NotGate();
+		AddUnit(nonZero).AddUnit(isZero).AddUnit(jz).AddUnit(jnz).AddUnit(jump).AddUnit(sequential).AddUnit(running);
+		regFile->ConnectBus(0, nonZero->Bus(0, 8));
+		nonZero->Connect(0, isZero, 0);
+		decoder->Connect(JZ, jz, 0);
+		isZero->Connect(0, jz, 1);
+		decoder->Connect(JNZ, jnz, 0);
+		nonZero->Connect(0, jnz, 1);
+		decoder->Connect(JMP, jump, 0);
+		jz->Connect(0, jump, 1);
+		jnz->Connect(0, jump, 2);
+		jump->Connect(0, sequential, 0);
+		Bus8bit* nextPC = new Bus8bit();
+		AddUnit(nextPC);
+		Drive(nextPC, incrementer, 0, sequential, 0);
+		Drive(nextPC, rom, 0, jump, 0);
+		nextPC->ConnectBus(0, pc->Bus(0, 8));
+		decoder->Connect(HLT, running, 0);
+		running->Connect(0, pc, 9);
+	}
 
+	void Do() override {
+		Excute();
+	}
+
+	//执行一条指令（CyclesPerInstruction 个周期），停机后返回 false
+	bool StepInstruction() {
+		if (Halted()) return false;
+		Run(CyclesPerInstruction);
+		instructions++;
+		return !Halted();
+	}
+
+	//最多执行 maxInstructions 条指令，返回实际执行的条数
+	size_t RunInstructions(size_t maxInstructions) {
+		size_t before = instructions;
+		while (instructions - before < maxInstructions && StepInstruction()) {}
+		return instructions - before;
+	}
+
+	bool Halted() const { return Outputs[8].Output->isOne(); }
+	size_t Instructions() const { return instructions; }
+	uint8_t PC() {
+		Prepare();
+		return pc->Value();
+	}
+	uint8_t Reg(int index) {
+		Prepare();
+		return uint8_t(regFile->Read(size_t(index & 3)));
+	}
+	uint8_t Mem(int address) {
+		Prepare();
+		return dataMemory->Value(size_t(address & 7));
+	}
+
+	//在一组小程序上测量每秒执行的指令数，分别测试门级和行为级子单元；停机后换一个新的 CPU 重新开始，展开时间不计入
+	static void Benchmark(size_t instructionsPerProgram = 20000) {
+		struct Program {
+			const char* name;
+			std::vector<uint16_t> code;
+		};
+		std::vector<Program> programs = {
+			{ "sum", {
+				Encode(LDI, 0, 0, 0),
+				Encode(LDI, 1, 0, 100),
+				Encode(LDI, 2, 0, 1),
+				Encode(ADD, 0, 1),
+				Encode(SUB, 1, 2),
+				Encode(JNZ, 1, 0, 3),
+				Encode(HLT) } },
+			{ "fib", {
+				Encode(LDI, 0, 0, 0),
+				Encode(LDI, 1, 0, 1),
+				Encode(LDI, 3, 0, 12),
+				Encode(MOV, 2, 1),
+				Encode(ADD, 1, 0),
+				Encode(MOV, 0, 2),
+				Encode(LDI, 2, 0, 1),
+				Encode(SUB, 3, 2),
+				Encode(JNZ, 3, 0, 3),
+				Encode(HLT) } },
+			{ "memory", {
+				Encode(LDI, 0, 0, 7),
+				Encode(ST, 0, 0, 0),
+				Encode(LD, 1, 0, 0),
+				Encode(NOT, 1),
+				Encode(ST, 0, 1, 1),
+				Encode(LD, 2, 0, 1),
+				Encode(OR, 2, 0),
+				Encode(AND, 2, 1),
+				Encode(ST, 0, 2, 2),
+				Encode(LDI, 3, 0, 1),
+				Encode(SUB, 0, 3),
+				Encode(JNZ, 0, 0, 1),
+				Encode(HLT) } },
+		};
+
+		for (bool gate : { true, false }) {
+			for (const Program& p : programs) {
+				size_t budget = gate ? instructionsPerProgram / 10 : instructionsPerProgram;
+				size_t executed = 0;
+				double seconds = 0;
+				while (executed < budget) {
+					CPU cpu(p.code, gate);
+					cpu.Prepare();
+					auto start = std::chrono::steady_clock::now();
+					executed += cpu.RunInstructions(budget - executed);
+					seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				}
+				std::print("{} {}: {} instructions, {} instructions/sec\n",
+					gate ? "gate-level" : "behavioral", p.name, executed, double(executed) / seconds);
+			}
+		}
 	}
 };
\ No newline at end of file
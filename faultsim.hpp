@@ -0,0 +1,292 @@
+#pragma once
+
+#include"netlist.hpp"
+#include<atomic>
+#include<typeinfo>
+
+//单固定故障：网络固定为0或1
+struct StuckAtFault {
+	uint32_t Net;
+	bool Value;
+	Unit* Source;//驱动该网络的单元，根单元输入为 nullptr
+};
+
+//一组测试向量，每个向量按被测单元的输入顺序给出 0/1
+//时序电路中一个向量对应一个周期，时钟也由向量给出
+struct TestSet {
+	std::string Name;
+	std::vector<std::vector<int>> Patterns;
+};
+
+struct FaultReport {
+	std::string Name;
+	size_t Patterns = 0;
+	size_t Total = 0;
+	size_t Detected = 0;
+	std::vector<StuckAtFault> Undetected;
+
+	double Coverage() const { return Total ? 100.0 * double(Detected) / double(Total) : 100.0; }
+
+	void Print(bool listUndetected = false) const {
+		std::print("{} Fault coverage: {}/{} ({:.2f}%), {} patterns\n", Name, Detected, Total, Coverage(), Patterns);
+		if (!listUndetected) return;
+		for (const StuckAtFault& f : Undetected) {
+			std::print("  undetected: net {} stuck-at-{} ({})\n", f.Net, int(f.Value),
+				f.Source ? typeid(*f.Source).name() : "input");
+		}
+	}
+};
+
+//并行向量故障模拟：一个64位字同时模拟64个故障电路，与好电路的输出比较
+//故障组分配到多个线程，检测到的故障立即丢弃
+class FaultSimulator {
+private:
+	struct Injection {
+		uint64_t clear;
+		uint64_t set;
+	};
+
+	//单个线程的模拟状态
+	struct Machine {
+		std::vector<uint64_t> w;
+		std::vector<uint64_t> q;
+		std::vector<uint64_t> last;
+		std::vector<int32_t> inject;//网络 -> 注入表下标，-1表示无故障
+		std::vector<Injection> injections;
+		std::vector<uint32_t> injectedNets;
+	};
+
+	Netlist net;
+	std::vector<StuckAtFault> faults;
+	std::vector<uint64_t> initial;
+	unsigned threadCount;
+	bool combinational = true;
+
+	static constexpr size_t ChunkPatterns = 64;//组合电路每处理这么多向量后重新打包剩余故障
+
+	void Reset(Machine& m) const {
+		m.w = initial;
+		std::fill(m.q.begin(), m.q.end(), 0);
+		std::fill(m.last.begin(), m.last.end(), 0);
+	}
+
+	void Load(Machine& m, const uint32_t* group, size_t count) const {
+		for (uint32_t n : m.injectedNets) m.inject[n] = -1;
+		m.injectedNets.clear();
+		m.injections.clear();
+		for (size_t j = 0; j < count; j++) {
+			const StuckAtFault& f = faults[group[j]];
+			int32_t& k = m.inject[f.Net];
+			if (k < 0) {
+				k = int32_t(m.injections.size());
+				m.injections.push_back({ 0, 0 });
+				m.injectedNets.push_back(f.Net);
+			}
+			if (f.Value) m.injections[k].set |= uint64_t(1) << j;
+			else m.injections[k].clear |= uint64_t(1) << j;
+		}
+	}
+
+	static void Apply(Machine& m, uint32_t n) {
+		int32_t k = m.inject[n];
+		if (k >= 0) {
+			m.w[n] = (m.w[n] & ~m.injections[k].clear) | m.injections[k].set;
+		}
+	}
+
+	//执行一个向量（一个周期）
+	void Evaluate(Machine& m, const std::vector<int>& pattern) const {
+		uint64_t* w = m.w.data();
+		for (size_t i = 0; i < net.Inputs.size(); i++) {
+			w[net.Inputs[i]] = pattern[i] == 1 ? ~uint64_t(0) : 0;
+			Apply(m, net.Inputs[i]);
+		}
+		for (const Netlist::Gate& g : net.Gates) {
+			uint64_t a = w[g.in[0]];
+			uint64_t b = w[g.in[1]];
+			uint64_t v = 0;
+			switch (g.op) {
+			case Netlist::Op::And: v = a & b; break;
+			case Netlist::Op::Or:
+			case Netlist::Op::Resolve: v = a | b; break;
+			case Netlist::Op::Xor: v = a ^ b; break;
+			case Netlist::Op::Not: v = ~a; break;
+			case Netlist::Op::Buf: v = a; break;
+			case Netlist::Op::Const1: v = ~uint64_t(0); break;
+			case Netlist::Op::Tri: v = a & b; break;//高阻按0读取
+			case Netlist::Op::Dec3: {
+				uint64_t c = w[g.in[2]];
+				v = ((g.aux & 1) ? a : ~a) & ((g.aux & 2) ? b : ~b) & ((g.aux & 4) ? c : ~c);
+				break;
+			}
+			case Netlist::Op::Latch: {
+				uint64_t& s = m.q[g.in[2]];
+				s = (a & b) | (~a & s);
+				v = s;
+				break;
+			}
+			case Netlist::Op::Dff: {
+				//字中没有高阻，浮空的 D 按0采样，与 DFlipFlop 经节点解析读到的值一致
+				uint64_t& q = m.q[g.in[2]];
+				uint64_t& last = m.last[g.in[2]];
+				uint64_t rising = ~last & b;
+				q = (rising & a) | (~rising & q);
+				last = b;
+				v = q;
+				break;
+			}
+			case Netlist::Op::Lut: v = Netlist::EvalLutWord(net.Luts[g.in[0]], w); break;
+			case Netlist::Op::Opaque: break;
+			}
+			w[g.out] = v;
+			Apply(m, g.out);
+		}
+	}
+
+	//模拟一组故障，返回被检测到的位
+	uint64_t SimulateGroup(Machine& m, const uint32_t* group, size_t count,
+		const TestSet& set, size_t first, size_t last,
+		const std::vector<std::vector<uint64_t>>& good) const {
+		Load(m, group, count);
+		if (first == 0 || !combinational) Reset(m);
+		uint64_t live = count == 64 ? ~uint64_t(0) : ((uint64_t(1) << count) - 1);
+		uint64_t detected = 0;
+		for (size_t p = first; p < last && live; p++) {
+			Evaluate(m, set.Patterns[p]);
+			uint64_t diff = 0;
+			for (size_t o = 0; o < net.Outputs.size(); o++) {
+				diff |= m.w[net.Outputs[o]] ^ good[p][o];
+			}
+			diff &= live;
+			detected |= diff;
+			live &= ~diff;
+		}
+		return detected;
+	}
+
+public:
+	//dut 的输入作为测试向量输入，输出作为观测点
+	FaultSimulator(Unit* dut, unsigned threads = 0) : net(dut), threadCount(threads) {
+		if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<bool> written(net.NetCount(), false);
+		std::vector<bool> driven(net.NetCount(), false);
+		for (const Netlist::Gate& g : net.Gates) {
+			if (g.op == Netlist::Op::Opaque) {
+				throw std::runtime_error("Fault simulation does not support behavioral unit in DUT");
+			}
+			driven[g.out] = true;
+		}
+		//只检查门实际读取的网络：Dff/Latch 的 in[2] 是状态槽，Lut 的 in[0] 是查找表下标
+		auto read = [&](uint32_t in) {
+			if (driven[in] && !written[in]) combinational = false;//反馈回路
+		};
+		for (const Netlist::Gate& g : net.Gates) {
+			if (g.op == Netlist::Op::Lut) {
+				const Netlist::Lut& lut = net.Luts[g.in[0]];
+				for (size_t k = 0; k < lut.count; k++) read(lut.in[k]);
+			}
+			else {
+				for (size_t k = 0; k < Netlist::Arity(g.op); k++) read(g.in[k]);
+			}
+			written[g.out] = true;
+		}
+		if (net.HasState()) combinational = false;
+
+		initial.resize(net.NetCount());
+		for (uint32_t n = 0; n < net.NetCount(); n++) {
+			initial[n] = net.InitialValue(n) ? ~uint64_t(0) : 0;
+		}
+
+		//每个单元输出网络和每个输入网络各有固定0、固定1两个故障
+		std::vector<bool> seen(net.NetCount(), false);
+		auto add = [&](uint32_t n, Unit* source) {
+			if (seen[n] || n == Netlist::Zero) return;
+			seen[n] = true;
+			faults.push_back({ n, false, source });
+			faults.push_back({ n, true, source });
+		};
+		for (uint32_t n : net.Inputs) add(n, nullptr);
+		for (const Netlist::Gate& g : net.Gates) {
+			if (net.NetBits[g.out]) add(g.out, net.NetDriver[g.out]);
+		}
+	}
+
+	const std::vector<StuckAtFault>& Faults() const { return faults; }
+
+	FaultReport Run(const TestSet& set) const {
+		for (const auto& pattern : set.Patterns) {
+			if (pattern.size() != net.Inputs.size()) {
+				throw std::runtime_error("Pattern width does not match DUT inputs");
+			}
+		}
+
+		//好电路
+		std::vector<std::vector<uint64_t>> good(set.Patterns.size());
+		{
+			Machine m;
+			m.inject.assign(net.NetCount(), -1);
+			m.q.assign(net.StateCount, 0);
+			m.last.assign(net.StateCount, 0);
+			Reset(m);
+			for (size_t p = 0; p < set.Patterns.size(); p++) {
+				Evaluate(m, set.Patterns[p]);
+				for (uint32_t o : net.Outputs) good[p].push_back(m.w[o]);
+			}
+		}
+
+		std::vector<Machine> machines(threadCount);
+		for (Machine& m : machines) {
+			m.inject.assign(net.NetCount(), -1);
+			m.q.assign(net.StateCount, 0);
+			m.last.assign(net.StateCount, 0);
+		}
+
+		std::vector<uint32_t> alive(faults.size());
+		for (uint32_t i = 0; i < alive.size(); i++) alive[i] = i;
+		std::vector<char> detected(faults.size(), 0);
+
+		size_t chunk = combinational ? ChunkPatterns : set.Patterns.size();
+		for (size_t first = 0; first < set.Patterns.size() && !alive.empty(); first += chunk) {
+			size_t last = std::min(first + chunk, set.Patterns.size());
+			size_t groups = (alive.size() + 63) / 64;
+			std::atomic<size_t> nextGroup{ 0 };
+			auto worker = [&](Machine& m) {
+				for (size_t gi = nextGroup++; gi < groups; gi = nextGroup++) {
+					size_t begin = gi * 64;
+					size_t count = std::min<size_t>(64, alive.size() - begin);
+					uint64_t hit = SimulateGroup(m, alive.data() + begin, count, set, first, last, good);
+					for (size_t j = 0; j < count; j++) {
+						if (hit >> j & 1) detected[alive[begin + j]] = 1;
+					}
+				}
+			};
+			size_t workers = std::min<size_t>(threadCount, groups);
+			if (workers <= 1) {
+				worker(machines[0]);
+			}
+			else {
+				std::vector<std::thread> pool;
+				for (size_t t = 0; t < workers; t++) pool.emplace_back(worker, std::ref(machines[t]));
+				for (auto& th : pool) th.join();
+			}
+			//丢弃已检测故障，剩余故障重新打包
+			alive.erase(std::remove_if(alive.begin(), alive.end(),
+				[&](uint32_t f) { return detected[f] != 0; }), alive.end());
+		}
+
+		FaultReport report;
+		report.Name = set.Name;
+		report.Patterns = set.Patterns.size();
+		report.Total = faults.size();
+		report.Detected = faults.size() - alive.size();
+		for (uint32_t f : alive) report.Undetected.push_back(faults[f]);
+		return report;
+	}
+
+	std::vector<FaultReport> Run(const std::vector<TestSet>& sets) const {
+		std::vector<FaultReport> reports;
+		for (const TestSet& set : sets) reports.push_back(Run(set));
+		return reports;
+	}
+};
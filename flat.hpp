@@ -0,0 +1,284 @@
+#pragma once
+
+#include"lutmap.hpp"
+#include<memory>
+
+//编译后的线性指令流，只读，可在多个引擎之间共享
+//网络值：0、1、2（高阻），读取时只看是否为1
+struct FlatProgram {
+	enum Opcode : uint8_t {
+		AND, OR, XOR, NOT, BUF, CONST1, TRI, DEC3, LATCH, DFF, RESOLVE, OPAQUE, LUT,
+		OPCODE_COUNT
+	};
+
+	struct Instr {
+		uint8_t op;
+		uint8_t aux;    // DEC3 的最小项编号
+		uint32_t in0;
+		uint32_t in1;
+		uint32_t in2;   // DEC3 第三个输入；LATCH/DFF 的状态槽；OPAQUE/LUT 为 Opaques/Luts 下标
+		uint32_t out;
+	};
+
+	std::vector<Instr> Code;
+	std::vector<uint8_t> InitialNets;
+	std::vector<Bit*> NetBits;
+	std::vector<Netlist::OpaqueUnit> Opaques;
+	std::vector<Netlist::Lut> Luts;
+	std::vector<uint32_t> Inputs;
+	std::vector<uint32_t> Outputs;
+	size_t StateCount = 0;
+	std::unordered_map<Bit*, uint32_t> NetIndex;
+
+	static uint8_t Load(const Bit* bit) {
+		if (!bit) return 0;
+		return bit->isHighZ() ? 2 : (bit->isOne() ? 1 : 0);
+	}
+
+	static void Store(Bit* bit, uint8_t value) {
+		if (value == 2) *bit = -1;
+		else *bit = Bit(value == 1);
+	}
+
+	static std::shared_ptr<FlatProgram> Compile(const Netlist& netlist) {
+		auto program = std::make_shared<FlatProgram>();
+		program->NetBits = netlist.NetBits;
+		program->Opaques = netlist.Opaques;
+		program->Luts = netlist.Luts;
+		program->Inputs = netlist.Inputs;
+		program->Outputs = netlist.Outputs;
+		program->StateCount = netlist.StateCount;
+		program->InitialNets.resize(netlist.NetCount());
+		for (uint32_t n = 0; n < netlist.NetCount(); n++) {
+			program->InitialNets[n] = Load(netlist.NetBits[n]);
+			if (netlist.NetBits[n]) program->NetIndex.emplace(netlist.NetBits[n], n);
+		}
+		program->Code.reserve(netlist.Gates.size());
+		for (const Netlist::Gate& g : netlist.Gates) {
+			Instr instr{ 0, g.aux, g.in[0], g.in[1], g.in[2], g.out };
+			switch (g.op) {
+			case Netlist::Op::And: instr.op = AND; break;
+			case Netlist::Op::Or: instr.op = OR; break;
+			case Netlist::Op::Resolve: instr.op = RESOLVE; break;
+			case Netlist::Op::Xor: instr.op = XOR; break;
+			case Netlist::Op::Not: instr.op = NOT; break;
+			case Netlist::Op::Buf: instr.op = BUF; break;
+			case Netlist::Op::Const1: instr.op = CONST1; break;
+			case Netlist::Op::Tri: instr.op = TRI; break;
+			case Netlist::Op::Dec3: instr.op = DEC3; break;
+			case Netlist::Op::Latch: instr.op = LATCH; break;
+			case Netlist::Op::Dff: instr.op = DFF; break;
+			case Netlist::Op::Opaque: instr.op = OPAQUE; instr.in2 = g.in[0]; break;
+			case Netlist::Op::Lut: instr.op = LUT; instr.in2 = g.in[0]; break;
+			}
+			program->Code.push_back(instr);
+		}
+		return program;
+	}
+
+	//mapLuts 为 true 时先把小组合锥映射为查找表
+	static std::shared_ptr<FlatProgram> Compile(circuit& c, bool mapLuts = false) {
+		Netlist netlist(c);
+		if (mapLuts) MapLuts(netlist);
+		return Compile(netlist);
+	}
+
+	//指令读写的网络（OPAQUE 为行为级单元记录的输入输出网络）
+	void Operands(const Instr& i, std::vector<uint32_t>& reads, std::vector<uint32_t>& writes) const {
+		reads.clear();
+		writes.clear();
+		switch (i.op) {
+		case CONST1: break;
+		case NOT:
+		case BUF: reads = { i.in0 }; break;
+		case DEC3: reads = { i.in0, i.in1, i.in2 }; break;
+		case LUT: {
+			const Netlist::Lut& lut = Luts[i.in2];
+			reads.assign(lut.in, lut.in + lut.count);
+			break;
+		}
+		case OPAQUE:
+			reads = Opaques[i.in2].inNets;
+			writes = Opaques[i.in2].outNets;
+			return;
+		default: reads = { i.in0, i.in1 }; break;
+		}
+		writes.push_back(i.out);
+	}
+
+	//按查找表的输入组合取出输出；未用的输入指向常0网络，不影响下标
+	static uint8_t LookUp(const Netlist::Lut& lut, const uint8_t* n) {
+		unsigned index = unsigned(n[lut.in[0]] == 1) | (unsigned(n[lut.in[1]] == 1) << 1)
+			| (unsigned(n[lut.in[2]] == 1) << 2) | (unsigned(n[lut.in[3]] == 1) << 3)
+			| (unsigned(n[lut.in[4]] == 1) << 4) | (unsigned(n[lut.in[5]] == 1) << 5);
+		return uint8_t((lut.table >> index) & 1);
+	}
+};
+
+//字节码解释执行引擎：代替逐单元的虚函数 Do()
+//GCC/Clang 下使用计算跳转分派，其他编译器使用 switch
+class FlatEngine {
+	friend class CycleSkipper;
+private:
+	std::shared_ptr<const FlatProgram> program;
+	std::vector<uint8_t> nets;
+	std::vector<uint8_t> q;
+	std::vector<uint8_t> last;
+	size_t cycle = 0;
+
+	void CallOpaque(uint32_t index) {
+		const Netlist::OpaqueUnit& opaque = program->Opaques[index];
+		for (uint32_t n : opaque.inNets) FlatProgram::Store(program->NetBits[n], nets[n]);
+		opaque.unit->Do();
+		for (uint32_t n : opaque.outNets) nets[n] = FlatProgram::Load(program->NetBits[n]);
+	}
+
+public:
+	explicit FlatEngine(std::shared_ptr<const FlatProgram> compiled) {
+		Load(std::move(compiled));
+	}
+
+	explicit FlatEngine(circuit& c, bool mapLuts = false) : FlatEngine(FlatProgram::Compile(c, mapLuts)) {}
+
+	//切换到另一个已编译的设计，状态从原始位重新载入
+	void Load(std::shared_ptr<const FlatProgram> compiled) {
+		program = std::move(compiled);
+		nets = program->InitialNets;
+		q.assign(program->StateCount, 0);
+		last.assign(program->StateCount, 0);
+		for (const FlatProgram::Instr& i : program->Code) {
+			if (i.op == FlatProgram::DFF || i.op == FlatProgram::LATCH) {
+				q[i.in2] = nets[i.out] == 1;
+				if (i.op == FlatProgram::DFF) last[i.in2] = nets[i.in1] == 1;
+			}
+		}
+		cycle = 0;
+	}
+
+	const FlatProgram& Program() const { return *program; }
+	size_t Cycle() const { return cycle; }
+
+	//执行一个周期
+	void Step() {
+		const FlatProgram::Instr* ip = program->Code.data();
+		const FlatProgram::Instr* end = ip + program->Code.size();
+		uint8_t* n = nets.data();
+		uint8_t* state = q.data();
+		uint8_t* clock = last.data();
+		const Netlist::Lut* luts = program->Luts.data();
+#if defined(__GNUC__)
+		static void* const labels[FlatProgram::OPCODE_COUNT] = {
+			&&op_and, &&op_or, &&op_xor, &&op_not, &&op_buf, &&op_const1,
+			&&op_tri, &&op_dec3, &&op_latch, &&op_dff, &&op_resolve, &&op_opaque, &&op_lut,
+		};
+#define FLAT_NEXT() do { if (++ip == end) return; goto *labels[ip->op]; } while (0)
+		if (ip == end) return;
+		goto *labels[ip->op];
+	op_and: n[ip->out] = (n[ip->in0] == 1) & (n[ip->in1] == 1); FLAT_NEXT();
+	op_or:
+	op_resolve: n[ip->out] = (n[ip->in0] == 1) | (n[ip->in1] == 1); FLAT_NEXT();
+	op_xor: n[ip->out] = (n[ip->in0] == 1) ^ (n[ip->in1] == 1); FLAT_NEXT();
+	op_not: n[ip->out] = n[ip->in0] != 1; FLAT_NEXT();
+	op_buf: n[ip->out] = n[ip->in0] == 1; FLAT_NEXT();
+	op_const1: n[ip->out] = 1; FLAT_NEXT();
+	op_tri: n[ip->out] = (n[ip->in1] == 1) ? uint8_t(n[ip->in0] == 1) : uint8_t(2); FLAT_NEXT();
+	op_dec3: n[ip->out] = ((n[ip->in0] == 1) | ((n[ip->in1] == 1) << 1) | ((n[ip->in2] == 1) << 2)) == ip->aux; FLAT_NEXT();
+	op_latch: {
+		uint8_t& s = state[ip->in2];
+		if (n[ip->in0] == 1) s = n[ip->in1] == 1;
+		n[ip->out] = s;
+		FLAT_NEXT();
+	}
+	op_dff: {
+		//D 为高阻时按0采样：DFlipFlop 经输入节点解析读 D，悬空的驱动被跳过后也是0，Do() 中保持 Q 的分支只在 D 位本身被直接置为高阻时才会走到
+		uint8_t clk = n[ip->in1] == 1;
+		if (!clock[ip->in2] && clk) state[ip->in2] = n[ip->in0] == 1;
+		clock[ip->in2] = clk;
+		n[ip->out] = state[ip->in2];
+		FLAT_NEXT();
+	}
+	op_lut: n[ip->out] = FlatProgram::LookUp(luts[ip->in2], n); FLAT_NEXT();
+	op_opaque:
+		CallOpaque(ip->in2);
+		n = nets.data();
+		FLAT_NEXT();
+#undef FLAT_NEXT
+#else
+		for (; ip != end; ++ip) {
+			switch (ip->op) {
+			case FlatProgram::AND: n[ip->out] = (n[ip->in0] == 1) & (n[ip->in1] == 1); break;
+			case FlatProgram::OR:
+			case FlatProgram::RESOLVE: n[ip->out] = (n[ip->in0] == 1) | (n[ip->in1] == 1); break;
+			case FlatProgram::XOR: n[ip->out] = (n[ip->in0] == 1) ^ (n[ip->in1] == 1); break;
+			case FlatProgram::NOT: n[ip->out] = n[ip->in0] != 1; break;
+			case FlatProgram::BUF: n[ip->out] = n[ip->in0] == 1; break;
+			case FlatProgram::CONST1: n[ip->out] = 1; break;
+			case FlatProgram::TRI: n[ip->out] = (n[ip->in1] == 1) ? uint8_t(n[ip->in0] == 1) : uint8_t(2); break;
+			case FlatProgram::DEC3:
+				n[ip->out] = ((n[ip->in0] == 1) | ((n[ip->in1] == 1) << 1) | ((n[ip->in2] == 1) << 2)) == ip->aux;
+				break;
+			case FlatProgram::LATCH:
+				if (n[ip->in0] == 1) state[ip->in2] = n[ip->in1] == 1;
+				n[ip->out] = state[ip->in2];
+				break;
+			case FlatProgram::DFF: {
+				//D 为高阻时按0采样，同上
+				uint8_t clk = n[ip->in1] == 1;
+				if (!clock[ip->in2] && clk) state[ip->in2] = n[ip->in0] == 1;
+				clock[ip->in2] = clk;
+				n[ip->out] = state[ip->in2];
+				break;
+			}
+			case FlatProgram::LUT:
+				n[ip->out] = FlatProgram::LookUp(luts[ip->in2], n);
+				break;
+			case FlatProgram::OPAQUE:
+				CallOpaque(ip->in2);
+				break;
+			}
+		}
+#endif
+	}
+
+	//连续执行 cycles 个周期，返回累计周期数
+	size_t Run(size_t cycles) {
+		for (size_t i = 0; i < cycles; i++) {
+			Step();
+		}
+		cycle += cycles;
+		return cycle;
+	}
+
+	//网络值：0/1，-1表示高阻
+	int Value(uint32_t net) const {
+		return nets[net] == 2 ? -1 : nets[net];
+	}
+
+	//按原始位访问网络，未参与展开或已合并进查找表的位抛出异常
+	uint32_t NetOf(const Bit* bit) const {
+		auto it = program->NetIndex.find(const_cast<Bit*>(bit));
+		if (it == program->NetIndex.end()) {
+			throw std::runtime_error("Bit is not part of the compiled netlist");
+		}
+		return it->second;
+	}
+
+	//给网络赋值（例如驱动根单元的输入），value 为 -1 表示高阻
+	void Set(uint32_t net, int value) {
+		nets[net] = value == -1 ? 2 : uint8_t(value != 0);
+	}
+
+	//把网络值写回原始位，便于用原有接口读取结果
+	void SyncToBits() const {
+		for (uint32_t n = 0; n < nets.size(); n++) {
+			if (program->NetBits[n]) FlatProgram::Store(program->NetBits[n], nets[n]);
+		}
+	}
+
+	//从原始位重新读入网络值（外部修改了位之后调用）
+	void SyncFromBits() {
+		for (uint32_t n = 0; n < nets.size(); n++) {
+			if (program->NetBits[n]) nets[n] = FlatProgram::Load(program->NetBits[n]);
+		}
+	}
+};
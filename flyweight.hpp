@@ -0,0 +1,80 @@
+#pragma once
+
+#include"flat.hpp"
+#include<typeindex>
+
+//子线路的共享定义：同一种单元（类型加构造参数）只初始化、展开、编译一次
+//拓扑和执行顺序保存在只读的 FlatProgram 里，由所有实例共享
+class SharedDefinition {
+public:
+	std::shared_ptr<const FlatProgram> Program;
+	Unit* Prototype;      //编译用的原型，程序中的原始位指向它，不参与运行
+	bool Sequential;      //与原单元一致，决定实例在父线路中的执行阶段
+
+	//编译一个原型，原型必须完全是门级的：行为级单元的内部状态无法在实例之间拆开
+	explicit SharedDefinition(Unit* prototype) : Prototype(prototype), Sequential(prototype->isSequential()) {
+		if (circuit* c = dynamic_cast<circuit*>(prototype)) c->Prepare();
+		Netlist netlist(prototype);
+		if (!netlist.Opaques.empty()) {
+			throw std::runtime_error(std::string("Cannot share a definition with behavioral units: ") + typeid(*prototype).name());
+		}
+		Program = FlatProgram::Compile(netlist);
+	}
+
+	SharedDefinition(const SharedDefinition&) = delete;
+	SharedDefinition& operator=(const SharedDefinition&) = delete;
+
+	//按类型和构造参数取得定义，第一次调用时构建原型并编译，之后直接复用
+	template<class T, class... Args>
+	static std::shared_ptr<const SharedDefinition> Of(Args... args) {
+		std::string key = std::type_index(typeid(T)).name();
+		((key += ',', key += std::to_string(args)), ...);
+		static std::mutex mtx;
+		static std::unordered_map<std::string, std::shared_ptr<const SharedDefinition>> cache;
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = cache.find(key);
+		if (it != cache.end()) return it->second;
+		auto definition = std::make_shared<const SharedDefinition>(new T(args...));
+		cache.emplace(std::move(key), definition);
+		return definition;
+	}
+};
+
+//共享定义的实例：只保存网络值和时序状态，代替原单元接入线路
+//引脚编号与原单元相同，每个周期执行一遍共享的指令流，结果与原单元逐周期一致
+class SharedInstance : public Unit {
+private:
+	std::shared_ptr<const SharedDefinition> definition;
+	FlatEngine engine;
+
+public:
+	explicit SharedInstance(std::shared_ptr<const SharedDefinition> shared)
+		: Unit(shared->Program->Inputs.size(), shared->Program->Outputs.size()),
+		definition(std::move(shared)), engine(definition->Program) {}
+
+	//例如 SharedInstance::Of<ALU>(8) 代替 new ALU(8)
+	template<class T, class... Args>
+	static SharedInstance* Of(Args... args) {
+		return new SharedInstance(SharedDefinition::Of<T>(args...));
+	}
+
+	const SharedDefinition& Definition() const { return *definition; }
+
+	bool isSequential() const override { return definition->Sequential; }
+
+	//与原单元一致
+	bool CanFloat() const override { return definition->Prototype->CanFloat(); }
+
+	void Do() override {
+		const FlatProgram& program = engine.Program();
+		for (size_t i = 0; i < Inputs.size(); i++) {
+			engine.Set(program.Inputs[i], Input(i).isOne());
+		}
+		engine.Step();
+		for (size_t i = 0; i < Outputs.size(); i++) {
+			int value = engine.Value(program.Outputs[i]);
+			if (value == -1) Output(i) = -1;
+			else Output(i) = Bit(value == 1);
+		}
+	}
+};
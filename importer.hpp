@@ -0,0 +1,627 @@
+#pragma once
+
+#include"elec.hpp"
+#include<fstream>
+#include<sstream>
+#include<string_view>
+#include<deque>
+#include<memory>
+
+//从门级结构 Verilog 子集或 BLIF 导入的线路，用于加载 ISCAS-85/89、EPFL 等基准电路
+//根单元的输入为原始输入，输出为原始输出，按声明顺序排列
+//解析时只生成紧凑的门表，Init() 中再实例化为 AndGate/OrGate/XorGate/NotGate/DFlipFlop，时间和内存都与门数成线性
+//多输入门展开为两输入门链；没有时钟引脚的 BLIF 锁存器共用一个内部 Clock
+class ImportedCircuit : public Unit, public circuit {
+public:
+	//解析得到的门，输入在 Pins 中连续存放
+	struct ParsedGate {
+		enum class Kind : uint8_t { And, Or, Xor, Buf, Dff, Const1 };
+		Kind kind;
+		bool invert;
+		uint32_t out;
+		uint32_t first;
+		uint32_t count;//Dff 的输入为 D、CLK，CLK 为 NoNet 时使用内部时钟；Dff 的 invert 表示下降沿触发
+	};
+
+	struct Parsed {
+		std::string Name;
+		std::vector<std::string> NetNames;
+		std::vector<uint32_t> Inputs;
+		std::vector<uint32_t> Outputs;
+		std::vector<ParsedGate> Gates;
+		std::vector<uint32_t> Pins;
+		std::vector<uint32_t> InitialOnes;//初值为1的 Dff 在 Gates 中的下标，升序
+	};
+
+	static constexpr uint32_t NoNet = UINT32_MAX;
+
+private:
+	Parsed parsed;
+	std::vector<std::string> inputNames;
+	std::vector<std::string> outputNames;
+	size_t gateCount;
+
+	//把文本解析为门表，网络名按出现顺序编号
+	class Parser {
+	private:
+		const char* p;
+		const char* end;
+		size_t line = 1;
+		Parsed& out;
+		std::unordered_map<std::string_view, uint32_t> nets;
+		std::deque<std::string> names;//展开总线等生成的名字
+		std::unordered_map<uint32_t, uint32_t> inverted;//网络 -> 取反后的网络
+
+		[[noreturn]] void Fail(const std::string& message) {
+			throw std::runtime_error("Line " + std::to_string(line) + ": " + message);
+		}
+
+	public:
+		Parser(std::string_view text, Parsed& parsed) : p(text.data()), end(text.data() + text.size()), out(parsed) {
+			nets.reserve(text.size() / 16);
+		}
+
+		uint32_t Net(std::string_view name) {
+			auto it = nets.find(name);
+			if (it != nets.end()) return it->second;
+			uint32_t n = uint32_t(out.NetNames.size());
+			out.NetNames.emplace_back(name);
+			nets.emplace(name, n);
+			return n;
+		}
+
+		uint32_t Temp() {
+			names.push_back("$t" + std::to_string(out.NetNames.size()));
+			return Net(names.back());
+		}
+
+		std::string_view Keep(std::string name) {
+			names.push_back(std::move(name));
+			return names.back();
+		}
+
+		uint32_t Gate(ParsedGate::Kind kind, bool invert, const uint32_t* in, size_t count, uint32_t result = NoNet) {
+			if (result == NoNet) result = Temp();
+			out.Gates.push_back({ kind, invert, result, uint32_t(out.Pins.size()), uint32_t(count) });
+			out.Pins.insert(out.Pins.end(), in, in + count);
+			return result;
+		}
+
+		uint32_t Not(uint32_t n) {
+			auto it = inverted.find(n);
+			if (it != inverted.end()) return it->second;
+			uint32_t r = Gate(ParsedGate::Kind::Buf, true, &n, 1);
+			inverted.emplace(n, r);
+			return r;
+		}
+
+		// ---------------- Verilog ----------------
+
+		void SkipSpace() {
+			while (p < end) {
+				if (*p == '\n') {
+					line++;
+					p++;
+				}
+				else if (*p == ' ' || *p == '\t' || *p == '\r') p++;
+				else if (*p == '/' && p + 1 < end && p[1] == '/') {
+					while (p < end && *p != '\n') p++;
+				}
+				else if (*p == '/' && p + 1 < end && p[1] == '*') {
+					p += 2;
+					while (p + 1 < end && !(*p == '*' && p[1] == '/')) {
+						if (*p == '\n') line++;
+						p++;
+					}
+					p += 2;
+				}
+				else break;
+			}
+		}
+
+		static bool IsIdent(char c) {
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '$';
+		}
+
+		//标识符（含转义标识符和位选择 a[3]），或单个符号
+		std::string_view Token() {
+			SkipSpace();
+			if (p >= end) return {};
+			const char* start = p;
+			if (*p == '\\') {
+				start = ++p;
+				while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+				return { start, size_t(p - start) };
+			}
+			if (IsIdent(*p)) {
+				while (p < end && (IsIdent(*p) || *p == '\'')) p++;
+				//位选择紧跟在名字后面
+				const char* save = p;
+				size_t saveLine = line;
+				SkipSpace();
+				if (p < end && *p == '[') {
+					const char* close = p;
+					while (close < end && *close != ']' && *close != ';') close++;
+					if (close < end && *close == ']' && std::string_view(p + 1, size_t(close - p - 1)).find(':') == std::string_view::npos) {
+						std::string name(start, size_t(save - start));
+						for (const char* c = p; c <= close; c++) {
+							if (*c != ' ' && *c != '\t') name += *c;
+						}
+						p = close + 1;
+						return Keep(std::move(name));
+					}
+				}
+				p = save;
+				line = saveLine;
+				return { start, size_t(p - start) };
+			}
+			return { p++, 1 };
+		}
+
+		void Expect(std::string_view t) {
+			std::string_view got = Token();
+			if (got != t) Fail("expected '" + std::string(t) + "' but got '" + std::string(got) + "'");
+		}
+
+		//声明列表：input [7:0] a, b;
+		void Declare(std::vector<uint32_t>* list) {
+			int msb = -1, lsb = -1;
+			SkipSpace();
+			if (p < end && *p == '[') {
+				p++;
+				msb = std::stoi(std::string(Token()));
+				Expect(":");
+				lsb = std::stoi(std::string(Token()));
+				Expect("]");
+			}
+			for (;;) {
+				std::string_view name = Token();
+				if (name.empty()) Fail("unexpected end of file");
+				if (msb < 0) {
+					uint32_t n = Net(name);
+					if (list) list->push_back(n);
+				}
+				else {
+					int step = msb >= lsb ? -1 : 1;
+					for (int i = msb;; i += step) {
+						uint32_t n = Net(Keep(std::string(name) + "[" + std::to_string(i) + "]"));
+						if (list) list->push_back(n);
+						if (i == lsb) break;
+					}
+				}
+				std::string_view sep = Token();
+				if (sep == ";") return;
+				if (sep != ",") Fail("expected ',' or ';' in declaration");
+			}
+		}
+
+		uint32_t Constant(std::string_view t) {
+			//1'b0 / 1'b1 / 0 / 1
+			char v = t.back();
+			if (v != '0' && v != '1') Fail("unsupported constant '" + std::string(t) + "'");
+			if (v == '0') return NoNet;
+			return Gate(ParsedGate::Kind::Const1, false, nullptr, 0);
+		}
+
+		uint32_t Operand(std::string_view t) {
+			if (!t.empty() && t[0] >= '0' && t[0] <= '9') return Constant(t);
+			return Net(t);
+		}
+
+		//assign 右侧表达式：~ > & > ^ > |
+		uint32_t Primary() {
+			std::string_view t = Token();
+			if (t == "~" || t == "!") {
+				uint32_t a = Primary();
+				if (a == NoNet) return Gate(ParsedGate::Kind::Const1, false, nullptr, 0);
+				return Not(a);
+			}
+			if (t == "(") {
+				uint32_t a = OrExpr();
+				Expect(")");
+				return a;
+			}
+			if (t.empty() || (t.size() == 1 && !IsIdent(t[0]))) Fail("unexpected '" + std::string(t) + "' in expression");
+			return Operand(t);
+		}
+
+		uint32_t Binary(ParsedGate::Kind kind, uint32_t a, uint32_t b) {
+			uint32_t in[2] = { a, b };
+			return Gate(kind, false, in, 2);
+		}
+
+		bool Peek(char c) {
+			SkipSpace();
+			return p < end && *p == c;
+		}
+
+		uint32_t AndExpr() {
+			uint32_t a = Primary();
+			while (Peek('&')) {
+				p++;
+				a = Binary(ParsedGate::Kind::And, a, Primary());
+			}
+			return a;
+		}
+
+		uint32_t XorExpr() {
+			uint32_t a = AndExpr();
+			while (Peek('^')) {
+				p++;
+				a = Binary(ParsedGate::Kind::Xor, a, AndExpr());
+			}
+			return a;
+		}
+
+		uint32_t OrExpr() {
+			uint32_t a = XorExpr();
+			while (Peek('|')) {
+				p++;
+				a = Binary(ParsedGate::Kind::Or, a, XorExpr());
+			}
+			return a;
+		}
+
+		//门原语：and g1 (y, a, b, ...);  ISCAS-89 的 dff g (CK, Q, D);
+		void Primitive(std::string_view type) {
+			static const std::unordered_map<std::string_view, std::pair<ParsedGate::Kind, bool>> primitives = {
+				{ "and", { ParsedGate::Kind::And, false } }, { "nand", { ParsedGate::Kind::And, true } },
+				{ "or", { ParsedGate::Kind::Or, false } }, { "nor", { ParsedGate::Kind::Or, true } },
+				{ "xor", { ParsedGate::Kind::Xor, false } }, { "xnor", { ParsedGate::Kind::Xor, true } },
+				{ "buf", { ParsedGate::Kind::Buf, false } }, { "not", { ParsedGate::Kind::Buf, true } },
+				{ "dff", { ParsedGate::Kind::Dff, false } },
+			};
+			auto it = primitives.find(type);
+			if (it == primitives.end()) Fail("unsupported cell '" + std::string(type) + "'");
+			std::string_view t = Token();
+			if (t != "(") {
+				t = Token();//实例名
+				if (t != "(") Fail("expected '('");
+			}
+			std::vector<uint32_t> ports;
+			for (;;) {
+				std::string_view name = Token();
+				ports.push_back(Operand(name));
+				t = Token();
+				if (t == ")") break;
+				if (t != ",") Fail("expected ',' or ')' in port list");
+			}
+			Expect(";");
+			auto [kind, invert] = it->second;
+			if (kind == ParsedGate::Kind::Dff) {
+				if (ports.size() != 3) Fail("dff expects (CK, Q, D)");
+				uint32_t in[2] = { ports[2], ports[0] };
+				Gate(kind, false, in, 2, ports[1]);
+				return;
+			}
+			if (ports.size() < 2) Fail("gate without inputs");
+			Gate(kind, invert, ports.data() + 1, ports.size() - 1, ports[0]);
+		}
+
+		void Verilog() {
+			for (;;) {
+				std::string_view t = Token();
+				if (t.empty()) break;
+				if (t == "module") {
+					out.Name = std::string(Token());
+					//端口列表只给出名字，方向由后面的声明决定
+					while (!(t = Token()).empty() && t != ";") {}
+				}
+				else if (t == "endmodule") break;
+				else if (t == "input") Declare(&out.Inputs);
+				else if (t == "output") Declare(&out.Outputs);
+				else if (t == "wire") Declare(nullptr);
+				else if (t == "assign") {
+					std::string_view lhs = Token();
+					uint32_t target = Net(lhs);
+					Expect("=");
+					uint32_t v = OrExpr();
+					Expect(";");
+					uint32_t in[1] = { v };
+					Gate(ParsedGate::Kind::Buf, false, in, v == NoNet ? 0 : 1, target);
+				}
+				else Primitive(t);
+			}
+		}
+
+		// ---------------- BLIF ----------------
+
+		//读一行（处理 \ 续行和 # 注释），拆成单词
+		bool Line(std::vector<std::string_view>& words) {
+			words.clear();
+			while (p < end) {
+				char c = *p;
+				if (c == '\n') {
+					p++;
+					line++;
+					if (!words.empty()) return true;
+				}
+				else if (c == ' ' || c == '\t' || c == '\r') p++;
+				else if (c == '#') {
+					while (p < end && *p != '\n') p++;
+				}
+				else if (c == '\\' && (p + 1 == end || p[1] == '\n' || p[1] == '\r')) {
+					//续行
+					while (p < end && *p != '\n') p++;
+					if (p < end) {
+						p++;
+						line++;
+					}
+				}
+				else {
+					const char* start = p;
+					while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n' && *p != '#') p++;
+					words.emplace_back(start, size_t(p - start));
+				}
+			}
+			return !words.empty();
+		}
+
+		//乘积项和：每行一个立方体，输出列为0时对整体取反
+		void Cover(const std::vector<uint32_t>& in, uint32_t result, const std::vector<std::string_view>& rows) {
+			std::vector<uint32_t> terms;
+			bool offSet = false;
+			bool constantOne = false;
+			for (std::string_view row : rows) {
+				std::vector<uint32_t> literals;
+				for (size_t k = 0; k < in.size(); k++) {
+					if (row[k] == '1') literals.push_back(in[k]);
+					else if (row[k] == '0') literals.push_back(Not(in[k]));
+					else if (row[k] != '-') Fail("bad cube '" + std::string(row) + "'");
+				}
+				offSet = row.back() == '0';
+				if (literals.empty()) constantOne = true;
+				else if (literals.size() == 1) terms.push_back(literals[0]);
+				else terms.push_back(Gate(ParsedGate::Kind::And, false, literals.data(), literals.size()));
+			}
+			if (rows.empty()) {
+				Gate(ParsedGate::Kind::Buf, false, nullptr, 0, result);//常0
+			}
+			else if (constantOne) {
+				if (offSet) Gate(ParsedGate::Kind::Buf, false, nullptr, 0, result);
+				else Gate(ParsedGate::Kind::Const1, false, nullptr, 0, result);
+			}
+			else {
+				Gate(terms.size() == 1 ? ParsedGate::Kind::Buf : ParsedGate::Kind::Or, offSet, terms.data(), terms.size(), result);
+			}
+		}
+
+		void Blif() {
+			std::vector<std::string_view> words;
+			bool pending = Line(words);
+			while (pending) {
+				if (words[0] == ".model") {
+					if (words.size() > 1) out.Name = std::string(words[1]);
+					pending = Line(words);
+				}
+				else if (words[0] == ".inputs" || words[0] == ".outputs") {
+					std::vector<uint32_t>& list = words[0] == ".inputs" ? out.Inputs : out.Outputs;
+					for (size_t i = 1; i < words.size(); i++) list.push_back(Net(words[i]));
+					pending = Line(words);
+				}
+				else if (words[0] == ".names") {
+					if (words.size() < 2) Fail(".names without output");
+					std::vector<uint32_t> in;
+					for (size_t i = 1; i + 1 < words.size(); i++) in.push_back(Net(words[i]));
+					uint32_t result = Net(words.back());
+					std::vector<std::string_view> rows;
+					std::deque<std::string> joined;
+					while ((pending = Line(words)) && words[0][0] != '.') {
+						if (in.empty()) {
+							rows.push_back(words[0]);
+						}
+						else {
+							if (words.size() != 2 || words[0].size() != in.size()) Fail("bad cover row");
+							joined.push_back(std::string(words[0]) + std::string(words[1]));
+							rows.push_back(joined.back());
+						}
+					}
+					Cover(in, result, rows);
+				}
+				else if (words[0] == ".latch") {
+					//.latch D Q [type control] [init]
+					//re/fe 为上升沿/下降沿触发；电平锁存器（ah/al）和异步类型（as）不支持
+					//初值 1 置位，0、2（无关）、3（未知）从0开始
+					if (words.size() < 3 || words.size() > 6) Fail(".latch expects D Q [type control] [init]");
+					uint32_t clock = NoNet;
+					bool falling = false;
+					size_t initAt = 3;
+					if (words.size() >= 5) {
+						if (words[3] != "re" && words[3] != "fe") {
+							Fail("unsupported .latch type '" + std::string(words[3]) + "'");
+						}
+						falling = words[3] == "fe";
+						if (words[4] != "NIL") clock = Net(words[4]);
+						initAt = 5;
+					}
+					bool one = false;
+					if (words.size() > initAt) {
+						std::string_view init = words[initAt];
+						if (init != "0" && init != "1" && init != "2" && init != "3") {
+							Fail("bad .latch initial value '" + std::string(init) + "'");
+						}
+						one = init == "1";
+					}
+					if (words.size() > initAt + 1) Fail(".latch expects D Q [type control] [init]");
+					if (one) out.InitialOnes.push_back(uint32_t(out.Gates.size()));
+					uint32_t in[2] = { Net(words[1]), clock };
+					Gate(ParsedGate::Kind::Dff, falling, in, 2, Net(words[2]));
+					pending = Line(words);
+				}
+				else if (words[0] == ".end" || words[0] == ".exdc") break;
+				else if (words[0] == ".subckt" || words[0] == ".gate" || words[0] == ".mlatch") {
+					Fail("unsupported BLIF construct '" + std::string(words[0]) + "'");
+				}
+				else pending = Line(words);//时序约束等其他指令忽略
+			}
+		}
+	};
+
+	//网络的驱动：单元输出、根单元输入或常0
+	struct Driver {
+		Unit* unit = nullptr;
+		uint32_t input = NoNet;
+	};
+
+public:
+	explicit ImportedCircuit(Parsed&& source)
+		: Unit(source.Inputs.size(), source.Outputs.size()), parsed(std::move(source)), gateCount(parsed.Gates.size()) {
+		name = parsed.Name;
+		for (uint32_t n : parsed.Inputs) inputNames.push_back(parsed.NetNames[n]);
+		for (uint32_t n : parsed.Outputs) outputNames.push_back(parsed.NetNames[n]);
+	}
+
+	static std::unique_ptr<ImportedCircuit> FromVerilog(std::string_view text) {
+		Parsed parsed;
+		Parser(text, parsed).Verilog();
+		return std::make_unique<ImportedCircuit>(std::move(parsed));
+	}
+
+	static std::unique_ptr<ImportedCircuit> FromBlif(std::string_view text) {
+		Parsed parsed;
+		Parser(text, parsed).Blif();
+		return std::make_unique<ImportedCircuit>(std::move(parsed));
+	}
+
+	//按扩展名选择格式：.blif 为 BLIF，其余按 Verilog 解析
+	static std::unique_ptr<ImportedCircuit> Load(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) throw std::runtime_error("Cannot open " + path);
+		std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		bool blif = path.size() >= 5 && path.compare(path.size() - 5, 5, ".blif") == 0;
+		return blif ? FromBlif(text) : FromVerilog(text);
+	}
+
+	const std::vector<std::string>& InputNames() const { return inputNames; }
+	const std::vector<std::string>& OutputNames() const { return outputNames; }
+	size_t GateCount() const { return gateCount; }//解析得到的门数（展开前）
+
+	void Init() override {
+		const size_t netCount = parsed.NetNames.size();
+		std::vector<Driver> drivers(netCount);
+		for (size_t i = 0; i < parsed.Inputs.size(); i++) drivers[parsed.Inputs[i]].input = uint32_t(i);
+
+		//待连接的输入引脚，所有驱动确定之后统一连接
+		struct Pin {
+			Unit* unit;
+			uint32_t index;
+			uint32_t net;
+		};
+		std::vector<Pin> pins;
+		pins.reserve(parsed.Pins.size() + parsed.Gates.size());
+		Clock* clock = nullptr;
+		std::vector<DFlipFlop*> initialOnes;
+		const uint32_t* nextOne = parsed.InitialOnes.data();
+		const uint32_t* lastOne = nextOne + parsed.InitialOnes.size();
+
+		for (const ParsedGate& g : parsed.Gates) {
+			const uint32_t* in = parsed.Pins.data() + g.first;
+			Unit* last = nullptr;
+			switch (g.kind) {
+			case ParsedGate::Kind::Const1: {
+				last = new PullUp();
+				AddUnit(last);
+				break;
+			}
+			case ParsedGate::Kind::Dff: {
+				bool one = nextOne != lastOne && *nextOne == uint32_t(&g - parsed.Gates.data());
+				if (one) nextOne++;
+				DFlipFlop* dff = one ? new DFlipFlop(true) : new DFlipFlop();
+				AddUnit(dff);
+				if (one) initialOnes.push_back(dff);
+				pins.push_back({ dff, 0, in[0] });
+				//下降沿触发：时钟取反后接到 CLK
+				Unit* clockPin = dff;
+				size_t clockIndex = 1;
+				if (g.invert) {
+					NotGate* inv = new NotGate();
+					AddUnit(inv);
+					inv->Connect(0, dff, 1);
+					clockPin = inv;
+					clockIndex = 0;
+				}
+				if (in[1] == NoNet) {
+					if (!clock) {
+						clock = new Clock();
+						AddUnit(clock);
+					}
+					clock->Connect(0, clockPin, clockIndex);
+				}
+				else {
+					pins.push_back({ clockPin, uint32_t(clockIndex), in[1] });
+				}
+				last = dff;
+				break;
+			}
+			default: {
+				if (g.count <= 1) {
+					//缓冲：两个输入接同一个网络的或门；没有输入时为常0
+					last = new OrGate();
+					AddUnit(last);
+					if (g.count == 1) {
+						pins.push_back({ last, 0, in[0] });
+						pins.push_back({ last, 1, in[0] });
+					}
+					break;
+				}
+				for (uint32_t k = 0; k + 1 < g.count; k++) {
+					Unit* u = g.kind == ParsedGate::Kind::And ? static_cast<Unit*>(new AndGate())
+						: g.kind == ParsedGate::Kind::Or ? static_cast<Unit*>(new OrGate())
+						: static_cast<Unit*>(new XorGate());
+					AddUnit(u);
+					if (k == 0) pins.push_back({ u, 0, in[0] });
+					else last->Connect(0, u, 0);
+					pins.push_back({ u, 1, in[k + 1] });
+					last = u;
+				}
+				break;
+			}
+			}
+			if (g.invert && g.kind != ParsedGate::Kind::Dff) {
+				NotGate* inv = new NotGate();
+				AddUnit(inv);
+				last->Connect(0, inv, 0);
+				last = inv;
+			}
+			if (g.out != NoNet) {
+				if (drivers[g.out].unit || drivers[g.out].input != NoNet) {
+					throw std::runtime_error("Net '" + parsed.NetNames[g.out] + "' has multiple drivers");
+				}
+				drivers[g.out].unit = last;
+			}
+		}
+
+		//原始输出必须在其他单元连接到驱动之前绑定，保证读取的是同一个位
+		std::vector<bool> bound(netCount, false);
+		for (size_t i = 0; i < parsed.Outputs.size(); i++) {
+			uint32_t n = parsed.Outputs[i];
+			if (drivers[n].unit && !bound[n]) {
+				SetOutput(i, drivers[n].unit, 0);
+				bound[n] = true;
+			}
+			else {
+				OrGate* buffer = new OrGate();
+				AddUnit(buffer);
+				pins.push_back({ buffer, 0, n });
+				pins.push_back({ buffer, 1, n });
+				SetOutput(i, buffer, 0);
+			}
+		}
+
+		for (const Pin& pin : pins) {
+			if (pin.net == NoNet) continue;
+			const Driver& d = drivers[pin.net];
+			if (d.unit) d.unit->Connect(0, pin.unit, pin.index);
+			else if (d.input != NoNet) SetInput(d.input, pin.unit, pin.index);
+			//没有驱动的网络读作0
+		}
+		//输出位在绑定到原始输出之后才确定，最后再写初值
+		for (DFlipFlop* dff : initialOnes) dff->Output(0) = 1;
+
+		parsed = Parsed();
+	}
+
+	void Do() override {
+		Excute();
+	}
+};
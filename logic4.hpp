@@ -0,0 +1,221 @@
+#pragma once
+
+#include"batched.hpp"
+
+//四值仿真引擎：执行 BatchedProgram，网络值为 Logic（每个网络一字节，便于逐个读写）
+//与、或、异或、非、解析按层内同操作码的段成批执行：操作数拼成两个位平面，用 SIMD 运算后写回
+//DFF/锁存器上电为 X，直到采样到确定的值；两值引擎中读作0的未初始化状态在这里可见
+//多驱动冲突、悬空输入进入门电路、时钟或使能未知时也得到 X；缓冲（连线）原样传递 Z
+//行为级单元（OPAQUE）仍通过 Bit 调用 Do()，X 按0传入
+class Logic4Engine {
+private:
+	std::shared_ptr<const BatchedProgram> program;
+	const FlatProgram* flat = nullptr;
+	std::vector<Logic> nets;
+	std::vector<Logic> q;
+	std::vector<Logic> last;
+	std::vector<uint64_t> planes;  //段内操作数和结果：x 的 A、B，y 的 A、B，结果的 A、B
+	size_t cycle = 0;
+
+	static Logic Known(Logic v) { return v == Logic::Z ? Logic::X : v; }
+
+	void Gather(const uint32_t* index, size_t count, uint64_t* a, uint64_t* b) const {
+		const Logic* n = nets.data();
+		for (size_t w = 0; w * 64 < count; w++) {
+			uint64_t va = 0, vb = 0;
+			size_t end = std::min<size_t>(64, count - w * 64);
+			for (size_t j = 0; j < end; j++) {
+				uint64_t v = uint64_t(n[index[w * 64 + j]]);
+				va |= (v & 1) << j;
+				vb |= (v >> 1) << j;
+			}
+			a[w] = va;
+			b[w] = vb;
+		}
+	}
+
+	void Scatter(const uint32_t* index, size_t count, const uint64_t* a, const uint64_t* b) {
+		Logic* n = nets.data();
+		for (size_t j = 0; j < count; j++) {
+			n[index[j]] = Logic(((a[j >> 6] >> (j & 63)) & 1) | (((b[j >> 6] >> (j & 63)) & 1) << 1));
+		}
+	}
+
+	template<class K> void Batch(uint32_t begin, uint32_t end, bool binary) {
+		size_t count = end - begin, words = (count + 63) / 64;
+		if (planes.size() < 6 * words) planes.resize(6 * words);
+		uint64_t* xa = planes.data(), * xb = xa + words, * ya = xb + words, * yb = ya + words, * a = yb + words, * b = a + words;
+		Gather(program->In0.data() + begin, count, xa, xb);
+		if (binary) Gather(program->In1.data() + begin, count, ya, yb);
+		else {
+			ya = xa;
+			yb = xb;
+		}
+		LogicVector::Run<K>(xa, xb, ya, yb, a, b, words);
+		Scatter(program->Out.data() + begin, count, a, b);
+	}
+
+	//按输入组合逐个求值，未知的输入取遍0和1，结果都相同才是确定值
+	Logic LookUp(const Netlist::Lut& lut) const {
+		unsigned known = 0, unknown = 0;
+		for (unsigned i = 0; i < 6; i++) {
+			Logic v = nets[lut.in[i]];
+			if (v == Logic::One) known |= 1u << i;
+			else if (v != Logic::Zero) unknown |= 1u << i;
+		}
+		unsigned first = unsigned((lut.table >> known) & 1);
+		for (unsigned s = unknown; s; s = (s - 1) & unknown) {
+			if (unsigned((lut.table >> (known | s)) & 1) != first) return Logic::X;
+		}
+		return Logic(first);
+	}
+
+	void CallOpaque(uint32_t index) {
+		const Netlist::OpaqueUnit& opaque = flat->Opaques[index];
+		for (uint32_t n : opaque.inNets) FlatProgram::Store(flat->NetBits[n], uint8_t(nets[n]));
+		opaque.unit->Do();
+		for (uint32_t n : opaque.outNets) nets[n] = ToLogic(*flat->NetBits[n]);
+	}
+
+	void Single(uint8_t op, uint32_t k) {
+		Logic* n = nets.data();
+		const uint32_t in0 = program->In0[k], in1 = program->In1[k], in2 = program->In2[k], out = program->Out[k];
+		switch (op) {
+		case FlatProgram::BUF:
+			n[out] = n[in0];
+			break;
+		case FlatProgram::CONST1:
+			n[out] = Logic::One;
+			break;
+		case FlatProgram::TRI: {
+			//使能为1输出数据（Z 按 X），为0输出高阻，未知时为 X
+			Logic en = n[in1];
+			n[out] = en == Logic::One ? Known(n[in0]) : (en == Logic::Zero ? Logic::Z : Logic::X);
+			break;
+		}
+		case FlatProgram::DEC3: {
+			//逐位比较后相与，已知不匹配的位直接得0
+			uint8_t aux = program->Aux[k];
+			Logic bits[3] = { n[in0], n[in1], n[in2] };
+			Logic v = Logic::One;
+			for (int i = 0; i < 3; i++) v = v & (((aux >> i) & 1) ? bits[i] : !bits[i]);
+			n[out] = v;
+			break;
+		}
+		case FlatProgram::LATCH: {
+			Logic en = n[in0], d = Known(n[in1]);
+			Logic& s = q[in2];
+			if (en == Logic::One) s = d;
+			else if (en != Logic::Zero && s != d) s = Logic::X;
+			n[out] = s;
+			break;
+		}
+		case FlatProgram::DFF: {
+			//确定的上升沿采样；时钟未知、可能有沿时状态与数据不同即为 X
+			Logic clk = Known(n[in1]), d = Known(n[in0]);
+			Logic& s = q[in2];
+			Logic& l = last[in2];
+			if (l == Logic::Zero && clk == Logic::One) s = d;
+			else if (l != Logic::One && clk != Logic::Zero && s != d) s = Logic::X;
+			l = clk;
+			n[out] = s;
+			break;
+		}
+		case FlatProgram::LUT:
+			n[out] = LookUp(flat->Luts[in2]);
+			break;
+		case FlatProgram::OPAQUE:
+			CallOpaque(in2);
+			break;
+		}
+	}
+
+public:
+	//powerUp 为 DFF/锁存器的初始状态，默认 X；传 Logic::Zero 得到与两值引擎相同的起点
+	explicit Logic4Engine(std::shared_ptr<const BatchedProgram> compiled, Logic powerUp = Logic::X) {
+		Load(std::move(compiled), powerUp);
+	}
+
+	explicit Logic4Engine(circuit& c, Logic powerUp = Logic::X, bool mapLuts = false)
+		: Logic4Engine(BatchedProgram::Compile(c, mapLuts), powerUp) {}
+
+	void Load(std::shared_ptr<const BatchedProgram> compiled, Logic powerUp = Logic::X) {
+		program = std::move(compiled);
+		flat = program->Flat.get();
+		nets.resize(flat->InitialNets.size());
+		for (uint32_t n = 0; n < nets.size(); n++) nets[n] = Logic(flat->InitialNets[n]);
+		q.assign(flat->StateCount, powerUp);
+		last.assign(flat->StateCount, Logic::Zero);
+		for (const FlatProgram::Instr& i : flat->Code) {
+			if (i.op == FlatProgram::DFF || i.op == FlatProgram::LATCH) {
+				if (powerUp != Logic::X) q[i.in2] = nets[i.out] == Logic::One ? Logic::One : Logic::Zero;
+				if (i.op == FlatProgram::DFF) last[i.in2] = Known(nets[i.in1]);
+				nets[i.out] = q[i.in2];
+			}
+		}
+		cycle = 0;
+	}
+
+	const BatchedProgram& Program() const { return *program; }
+	size_t Cycle() const { return cycle; }
+
+	//执行一个周期
+	void Step() {
+		for (const BatchedProgram::Segment& s : program->Segments) {
+			switch (s.op) {
+			case FlatProgram::AND: Batch<Logic4Kernel::And>(s.begin, s.end, true); break;
+			case FlatProgram::OR: Batch<Logic4Kernel::Or>(s.begin, s.end, true); break;
+			case FlatProgram::XOR: Batch<Logic4Kernel::Xor>(s.begin, s.end, true); break;
+			case FlatProgram::RESOLVE: Batch<Logic4Kernel::Resolve>(s.begin, s.end, true); break;
+			case FlatProgram::NOT: Batch<Logic4Kernel::Not>(s.begin, s.end, false); break;
+			default:
+				for (uint32_t k = s.begin; k < s.end; k++) Single(s.op, k);
+				break;
+			}
+		}
+	}
+
+	//连续执行 cycles 个周期，返回累计周期数
+	size_t Run(size_t cycles) {
+		for (size_t i = 0; i < cycles; i++) {
+			Step();
+		}
+		cycle += cycles;
+		return cycle;
+	}
+
+	Logic Value(uint32_t net) const { return nets[net]; }
+
+	//全部网络值打包成向量，下标为网络编号
+	LogicVector Nets() const {
+		LogicVector v(nets.size(), Logic::Zero);
+		for (size_t n = 0; n < nets.size(); n++) v.Set(n, nets[n]);
+		return v;
+	}
+
+	//值为 X 的网络数
+	size_t Unknowns() const { return size_t(std::count(nets.begin(), nets.end(), Logic::X)); }
+
+	uint32_t NetOf(const Bit* bit) const {
+		auto it = flat->NetIndex.find(const_cast<Bit*>(bit));
+		if (it == flat->NetIndex.end()) {
+			throw std::runtime_error("Bit is not part of the compiled netlist");
+		}
+		return it->second;
+	}
+
+	void Set(uint32_t net, Logic value) { nets[net] = value; }
+
+	//写回原始位，X 按0写入
+	void SyncToBits() const {
+		for (uint32_t n = 0; n < nets.size(); n++) {
+			if (flat->NetBits[n]) FlatProgram::Store(flat->NetBits[n], uint8_t(nets[n]));
+		}
+	}
+
+	void SyncFromBits() {
+		for (uint32_t n = 0; n < nets.size(); n++) {
+			if (flat->NetBits[n]) nets[n] = ToLogic(*flat->NetBits[n]);
+		}
+	}
+};
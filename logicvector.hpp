@@ -0,0 +1,280 @@
+#pragma once
+
+#include<cstdint>
+#include<vector>
+#include<string>
+#include<stdexcept>
+#include<bit>
+#if defined(__AVX2__)
+#include<immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include<emmintrin.h>
+#define LOGIC4_SSE2
+#endif
+
+class Bit;
+class Unit;
+
+//四值逻辑：0、1、Z（高阻）、X（未知/冲突）
+//按两个位平面编码：A 为值平面，B 为未知平面
+//	0 = (0,0)  1 = (1,0)  Z = (0,1)  X = (1,1)
+//门的输入中 Z 按 X 处理；Bit 没有 X，写回 Bit 时 X 按0写入
+enum class Logic : uint8_t { Zero = 0, One = 1, Z = 2, X = 3 };
+
+inline char LogicChar(Logic v) {
+	return "01zx"[uint8_t(v)];
+}
+
+//位平面运算的几种实现，运算式只写一遍（见 Logic4Kernel），按字宽实例化
+struct ScalarLanes {
+	using W = uint64_t;
+	static constexpr size_t Words = 1;
+	static W Load(const uint64_t* p) { return *p; }
+	static void Store(uint64_t* p, W w) { *p = w; }
+	static W And(W x, W y) { return x & y; }
+	static W Or(W x, W y) { return x | y; }
+	static W Xor(W x, W y) { return x ^ y; }
+	static W AndNot(W x, W y) { return ~x & y; }
+	static W Ones() { return ~uint64_t(0); }
+};
+
+#if defined(__AVX2__)
+struct WideLanes {
+	using W = __m256i;
+	static constexpr size_t Words = 4;
+	static W Load(const uint64_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+	static void Store(uint64_t* p, W w) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), w); }
+	static W And(W x, W y) { return _mm256_and_si256(x, y); }
+	static W Or(W x, W y) { return _mm256_or_si256(x, y); }
+	static W Xor(W x, W y) { return _mm256_xor_si256(x, y); }
+	static W AndNot(W x, W y) { return _mm256_andnot_si256(x, y); }
+	static W Ones() { return _mm256_set1_epi64x(-1); }
+};
+#elif defined(LOGIC4_SSE2)
+struct WideLanes {
+	using W = __m128i;
+	static constexpr size_t Words = 2;
+	static W Load(const uint64_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+	static void Store(uint64_t* p, W w) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), w); }
+	static W And(W x, W y) { return _mm_and_si128(x, y); }
+	static W Or(W x, W y) { return _mm_or_si128(x, y); }
+	static W Xor(W x, W y) { return _mm_xor_si128(x, y); }
+	static W AndNot(W x, W y) { return _mm_andnot_si128(x, y); }
+	static W Ones() { return _mm_set1_epi32(-1); }
+};
+#else
+using WideLanes = ScalarLanes;
+#endif
+
+//无分支的四值运算，输入 (xa,xb)、(ya,yb)，输出 (a,b)
+struct Logic4Kernel {
+	//任一输入为0得0，都为1得1，其余为 X
+	struct And {
+		template<class L> static void Run(typename L::W xa, typename L::W xb, typename L::W ya, typename L::W yb,
+			typename L::W& a, typename L::W& b) {
+			typename L::W zero = L::Xor(L::And(L::Or(xa, xb), L::Or(ya, yb)), L::Ones());
+			typename L::W one = L::AndNot(L::Or(xb, yb), L::And(xa, ya));
+			b = L::Xor(L::Or(zero, one), L::Ones());
+			a = L::Or(one, b);
+		}
+	};
+
+	//任一输入为1得1，都为0得0，其余为 X
+	struct Or {
+		template<class L> static void Run(typename L::W xa, typename L::W xb, typename L::W ya, typename L::W yb,
+			typename L::W& a, typename L::W& b) {
+			typename L::W one = L::Or(L::AndNot(xb, xa), L::AndNot(yb, ya));
+			typename L::W zero = L::Xor(L::Or(L::Or(xa, xb), L::Or(ya, yb)), L::Ones());
+			b = L::Xor(L::Or(zero, one), L::Ones());
+			a = L::Or(one, b);
+		}
+	};
+
+	//任一输入未知得 X
+	struct Xor {
+		template<class L> static void Run(typename L::W xa, typename L::W xb, typename L::W ya, typename L::W yb,
+			typename L::W& a, typename L::W& b) {
+			b = L::Or(xb, yb);
+			a = L::Or(L::Xor(xa, ya), b);
+		}
+	};
+
+	//只用第一个操作数
+	struct Not {
+		template<class L> static void Run(typename L::W xa, typename L::W xb, typename L::W, typename L::W,
+			typename L::W& a, typename L::W& b) {
+			b = xb;
+			a = L::Or(L::Xor(xa, L::Ones()), xb);
+		}
+	};
+
+	//线上两个驱动的解析：Z 让给另一方，相同的值保持，0 与 1 冲突或有 X 时为 X
+	struct Resolve {
+		template<class L> static void Run(typename L::W xa, typename L::W xb, typename L::W ya, typename L::W yb,
+			typename L::W& a, typename L::W& b) {
+			typename L::W xz = L::AndNot(xa, xb);
+			typename L::W yz = L::AndNot(ya, yb);
+			typename L::W conflict = L::AndNot(L::Or(xz, yz), L::Or(L::Or(L::Xor(xa, ya), xb), yb));
+			a = L::Or(L::Or(L::AndNot(xz, xa), L::And(xz, ya)), conflict);
+			b = L::Or(L::Or(L::AndNot(xz, xb), L::And(xz, yb)), conflict);
+		}
+	};
+
+	template<class K> static Logic Scalar(Logic x, Logic y) {
+		uint64_t a, b;
+		K::template Run<ScalarLanes>(uint8_t(x) & 1, uint8_t(x) >> 1, uint8_t(y) & 1, uint8_t(y) >> 1, a, b);
+		return Logic((a & 1) | ((b & 1) << 1));
+	}
+};
+
+inline Logic operator&(Logic x, Logic y) { return Logic4Kernel::Scalar<Logic4Kernel::And>(x, y); }
+inline Logic operator|(Logic x, Logic y) { return Logic4Kernel::Scalar<Logic4Kernel::Or>(x, y); }
+inline Logic operator^(Logic x, Logic y) { return Logic4Kernel::Scalar<Logic4Kernel::Xor>(x, y); }
+inline Logic operator!(Logic x) { return Logic4Kernel::Scalar<Logic4Kernel::Not>(x, x); }
+inline Logic Resolve(Logic x, Logic y) { return Logic4Kernel::Scalar<Logic4Kernel::Resolve>(x, y); }
+
+//压缩的四值向量：每64位一个字，两个位平面分开存放，长向量的运算按 SIMD 字宽成批处理
+//末字超出 Size 的位始终为0
+struct LogicVector {
+	std::vector<uint64_t> A;  //值平面
+	std::vector<uint64_t> B;  //未知平面
+	size_t Size = 0;
+
+	LogicVector() = default;
+	explicit LogicVector(size_t n, Logic fill = Logic::X) { Resize(n, fill); }
+
+	void Resize(size_t n, Logic fill = Logic::X) {
+		Size = n;
+		size_t words = (n + 63) / 64;
+		A.assign(words, (uint8_t(fill) & 1) ? ~uint64_t(0) : 0);
+		B.assign(words, (uint8_t(fill) & 2) ? ~uint64_t(0) : 0);
+		Trim();
+	}
+
+	size_t Words() const { return A.size(); }
+
+	Logic Get(size_t i) const {
+		return Logic(((A[i >> 6] >> (i & 63)) & 1) | (((B[i >> 6] >> (i & 63)) & 1) << 1));
+	}
+
+	void Set(size_t i, Logic v) {
+		uint64_t m = uint64_t(1) << (i & 63);
+		A[i >> 6] = (A[i >> 6] & ~m) | ((uint64_t(v) & 1) ? m : 0);
+		B[i >> 6] = (B[i >> 6] & ~m) | ((uint64_t(v) & 2) ? m : 0);
+	}
+
+	//等于 v 的位数
+	size_t Count(Logic v) const {
+		size_t count = 0;
+		for (size_t w = 0; w < A.size(); w++) {
+			uint64_t m = ((uint8_t(v) & 1) ? A[w] : ~A[w]) & ((uint8_t(v) & 2) ? B[w] : ~B[w]);
+			count += std::popcount(m & ValidMask(w));
+		}
+		return count;
+	}
+
+	//含 Z 或 X
+	bool HasUnknown() const {
+		for (uint64_t w : B) {
+			if (w) return true;
+		}
+		return false;
+	}
+
+	//按 Bit 的值读入，高阻为 Z（在 elec.hpp 中 Unit 之后定义）
+	static LogicVector FromBits(const std::vector<const Bit*>& bits);
+
+	//按 Node::Resolve4 解析单元的每个输入，驱动同时为0和1时为 X（在 elec.hpp 中 Unit 之后定义）
+	static LogicVector ResolveInputs(Unit& unit);
+
+	//取从 first 开始的 width 位
+	LogicVector Slice(size_t first, size_t width) const {
+		if (first > Size || width > Size - first) throw std::out_of_range("LogicVector slice out of range");
+		LogicVector r(width, Logic::Zero);
+		for (size_t w = 0; w < r.Words(); w++) {
+			r.A[w] = Extract(A, first + w * 64);
+			r.B[w] = Extract(B, first + w * 64);
+		}
+		r.Trim();
+		return r;
+	}
+
+	//低位在右
+	std::string ToString() const {
+		std::string s(Size, '0');
+		for (size_t i = 0; i < Size; i++) s[Size - 1 - i] = LogicChar(Get(i));
+		return s;
+	}
+
+	bool operator==(const LogicVector& other) const {
+		return Size == other.Size && A == other.A && B == other.B;
+	}
+
+	//对 words 个字的位平面按字宽成批执行 K，剩余的字逐个执行；输出可以与输入相同
+	template<class K> static void Run(const uint64_t* xa, const uint64_t* xb, const uint64_t* ya, const uint64_t* yb,
+		uint64_t* a, uint64_t* b, size_t words) {
+		size_t w = 0;
+		for (; w + WideLanes::Words <= words; w += WideLanes::Words) {
+			typename WideLanes::W ra, rb;
+			K::template Run<WideLanes>(WideLanes::Load(xa + w), WideLanes::Load(xb + w),
+				WideLanes::Load(ya + w), WideLanes::Load(yb + w), ra, rb);
+			WideLanes::Store(a + w, ra);
+			WideLanes::Store(b + w, rb);
+		}
+		for (; w < words; w++) K::template Run<ScalarLanes>(xa[w], xb[w], ya[w], yb[w], a[w], b[w]);
+	}
+
+	template<class K> static void Apply(const LogicVector& x, const LogicVector& y, LogicVector& out) {
+		if (x.Size != y.Size) throw std::out_of_range("LogicVector sizes differ");
+		if (out.Size != x.Size) out.Resize(x.Size);
+		Run<K>(x.A.data(), x.B.data(), y.A.data(), y.B.data(), out.A.data(), out.B.data(), x.Words());
+		out.Trim();
+	}
+
+	friend LogicVector operator&(const LogicVector& x, const LogicVector& y) {
+		LogicVector r;
+		Apply<Logic4Kernel::And>(x, y, r);
+		return r;
+	}
+	friend LogicVector operator|(const LogicVector& x, const LogicVector& y) {
+		LogicVector r;
+		Apply<Logic4Kernel::Or>(x, y, r);
+		return r;
+	}
+	friend LogicVector operator^(const LogicVector& x, const LogicVector& y) {
+		LogicVector r;
+		Apply<Logic4Kernel::Xor>(x, y, r);
+		return r;
+	}
+	friend LogicVector operator!(const LogicVector& x) {
+		LogicVector r;
+		Apply<Logic4Kernel::Not>(x, x, r);
+		return r;
+	}
+	friend LogicVector Resolve(const LogicVector& x, const LogicVector& y) {
+		LogicVector r;
+		Apply<Logic4Kernel::Resolve>(x, y, r);
+		return r;
+	}
+
+private:
+	//从第 bit 位起的64位，超出末尾的部分为0
+	static uint64_t Extract(const std::vector<uint64_t>& plane, size_t bit) {
+		size_t w = bit >> 6, s = bit & 63;
+		uint64_t v = w < plane.size() ? plane[w] >> s : 0;
+		if (s && w + 1 < plane.size()) v |= plane[w + 1] << (64 - s);
+		return v;
+	}
+
+	uint64_t ValidMask(size_t w) const {
+		size_t rest = Size - w * 64;
+		return rest >= 64 ? ~uint64_t(0) : (uint64_t(1) << rest) - 1;
+	}
+
+	void Trim() {
+		if (!A.empty()) {
+			A.back() &= ValidMask(A.size() - 1);
+			B.back() &= ValidMask(B.size() - 1);
+		}
+	}
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include"netlist.hpp"
+
+//工艺映射：把输入不超过6个的小组合锥合并成一个查找表门
+//只合并纯组合门（与、或、异或、非、缓冲、译码、线或解析）；三态门输出可能为高阻，不参与合并，
+//所有输入在读取时都按"是否为1"解析，因此按0/1索引的真值表与原门完全等价
+//被合并的中间网络不再更新，它们与原始位解除对应，引擎的 NetOf 对这些位抛出异常；
+//网表的输出、Observed 和 keep 中的网络总是锥的根，不会被合并；返回减少的门数
+inline size_t MapLuts(Netlist& netlist, const std::vector<uint32_t>& keep = {}) {
+	using Op = Netlist::Op;
+	const size_t netCount = netlist.NetCount();
+	std::vector<Netlist::Gate>& gates = netlist.Gates;
+
+	auto mappable = [](Op op) {
+		switch (op) {
+		case Op::And: case Op::Or: case Op::Resolve: case Op::Xor:
+		case Op::Not: case Op::Buf: case Op::Dec3: case Op::Const1:
+			return true;
+		default:
+			return false;
+		}
+	};
+
+	//每个网络的读取次数、写入次数和（唯一）写入门
+	std::vector<uint32_t> readers(netCount, 0);
+	std::vector<uint32_t> writes(netCount, 0);
+	std::vector<size_t> writer(netCount, SIZE_MAX);
+	for (size_t i = 0; i < gates.size(); i++) {
+		const Netlist::Gate& g = gates[i];
+		for (size_t k = 0; k < Netlist::Arity(g.op); k++) readers[g.in[k]]++;
+		if (g.op == Op::Opaque) {
+			for (uint32_t n : netlist.Opaques[g.in[0]].inNets) readers[n]++;
+			for (uint32_t n : netlist.Opaques[g.in[0]].outNets) {
+				writes[n]++;
+				writer[n] = i;
+			}
+		}
+		else {
+			writes[g.out]++;
+			writer[g.out] = i;
+		}
+	}
+	for (const Netlist::Lut& lut : netlist.Luts) {
+		for (size_t k = 0; k < lut.count; k++) readers[lut.in[k]]++;
+	}
+	for (uint32_t n : netlist.Outputs) readers[n] += 2;
+	for (uint32_t n : netlist.Observed) readers[n] += 2;
+	for (uint32_t n : keep) readers[n] += 2;
+
+	std::vector<bool> absorbed(gates.size(), false);
+	std::vector<std::vector<size_t>> cones(gates.size());//根门 -> 锥内的门（按执行顺序）
+	std::vector<std::vector<uint32_t>> leaves(gates.size());
+
+	//从后往前选择根门，贪心地吸收只被本锥读取的前级门
+	for (size_t r = gates.size(); r-- > 0;) {
+		if (absorbed[r] || !mappable(gates[r].op) || writes[gates[r].out] != 1) continue;
+		std::vector<size_t> cone = { r };
+		std::vector<uint32_t> leaf;
+		for (size_t k = 0; k < Netlist::Arity(gates[r].op); k++) {
+			if (std::find(leaf.begin(), leaf.end(), gates[r].in[k]) == leaf.end()) leaf.push_back(gates[r].in[k]);
+		}
+		bool grown = true;
+		while (grown) {
+			grown = false;
+			for (size_t li = 0; li < leaf.size(); li++) {
+				uint32_t n = leaf[li];
+				size_t g = writer[n];
+				if (g == SIZE_MAX || g >= r || absorbed[g] || writes[n] != 1 || readers[n] != 1) continue;
+				if (!mappable(gates[g].op) || n == Netlist::Zero) continue;
+				std::vector<uint32_t> next = leaf;
+				next.erase(next.begin() + li);
+				for (size_t k = 0; k < Netlist::Arity(gates[g].op); k++) {
+					uint32_t in = gates[g].in[k];
+					if (std::find(next.begin(), next.end(), in) == next.end()) next.push_back(in);
+				}
+				if (next.size() > 6) continue;
+				//叶子在 g 和根门之间不能被改写，否则合并后读到的值不同
+				bool stable = true;
+				for (size_t k = 0; k < Netlist::Arity(gates[g].op); k++) {
+					uint32_t in = gates[g].in[k];
+					if (writer[in] != SIZE_MAX && writer[in] > g && writer[in] < r) stable = false;
+					if (writes[in] > 1) stable = false;
+				}
+				if (!stable) continue;
+				leaf = std::move(next);
+				cone.push_back(g);
+				grown = true;
+				break;
+			}
+		}
+		if (cone.size() < 2) continue;
+		std::sort(cone.begin(), cone.end());
+		for (size_t g : cone) {
+			if (g != r) absorbed[g] = true;
+		}
+		cones[r] = std::move(cone);
+		leaves[r] = std::move(leaf);
+	}
+
+	//计算每个锥的真值表
+	std::vector<uint8_t> value(netCount, 0);
+	std::vector<Netlist::Gate> mapped;
+	mapped.reserve(gates.size());
+	size_t removed = 0;
+	for (size_t i = 0; i < gates.size(); i++) {
+		if (absorbed[i]) {
+			netlist.Unbind(gates[i].out);
+			removed++;
+			continue;
+		}
+		if (cones[i].empty()) {
+			mapped.push_back(gates[i]);
+			continue;
+		}
+		Netlist::Lut lut{};
+		lut.count = uint8_t(leaves[i].size());
+		for (size_t k = 0; k < lut.count; k++) lut.in[k] = leaves[i][k];
+		for (uint32_t m = 0; m < (1u << lut.count); m++) {
+			value[Netlist::Zero] = 0;
+			for (size_t k = 0; k < lut.count; k++) value[lut.in[k]] = (m >> k) & 1;
+			for (size_t g : cones[i]) {
+				const Netlist::Gate& gate = gates[g];
+				uint8_t a = value[gate.in[0]], b = value[gate.in[1]], v = 0;
+				switch (gate.op) {
+				case Op::And: v = a & b; break;
+				case Op::Or: case Op::Resolve: v = a | b; break;
+				case Op::Xor: v = a ^ b; break;
+				case Op::Not: v = !a; break;
+				case Op::Buf: v = a; break;
+				case Op::Const1: v = 1; break;
+				case Op::Dec3: v = (a | (b << 1) | (value[gate.in[2]] << 2)) == gate.aux; break;
+				default: break;
+				}
+				value[gate.out] = v;
+			}
+			if (value[gates[i].out]) lut.table |= uint64_t(1) << m;
+		}
+		Netlist::Gate g;
+		g.op = Op::Lut;
+		g.in[0] = uint32_t(netlist.Luts.size());
+		g.out = gates[i].out;
+		g.unit = gates[i].unit;
+		netlist.Luts.push_back(lut);
+		mapped.push_back(g);
+	}
+	gates = std::move(mapped);
+	return removed;
+}
@@ -1,6 +1,147 @@
 ﻿#include"elec.hpp"
+#include"realtime.hpp"
+#include"metrics.hpp"
+#include"distributed.hpp"
+#include"bdd.hpp"
+#include"cycleskip.hpp"
+
+//分区仿真示例：16位计数器驱动4级串联的 ALU，每个 ALU 一个进程
+static PartitionedDesign AluChain() {
+	PartitionedDesign d;
+	circuit* c = new circuit();
+	d.Root = c;
+	Clock* clk = new Clock();
+	PullUp* one = new PullUp();
+	AdderNbit* inc = new AdderNbit(16);
+	c->AddUnit(clk).AddUnit(one).AddUnit(inc);
+	one->Connect(0, inc, 32);
+	std::vector<DFlipFlop*> count(16);
+	for (int i = 0; i < 16; i++) {
+		count[i] = new DFlipFlop();
+		inc->Connect(i, count[i], 0);
+		clk->Connect(0, count[i], 1);
+		count[i]->Connect(0, inc, i);
+		c->AddUnit(count[i]);
+	}
+	ALU* previous = nullptr;
+	for (int s = 0; s < 4; s++) {
+		ALU* alu = new ALU(16);
+		for (int i = 0; i < 16; i++) {
+			if (previous) previous->Connect(i, alu, i);
+			else count[i]->Connect(0, alu, i);
+			count[i]->Connect(0, alu, 16 + i);
+		}
+		c->AddUnit(alu);
+		d.Parts.push_back(alu);
+		previous = alu;
+	}
+	return d;
+}
+
+int main(int argc, char* argv[]) {
+	DistributedSimulation::Register("alu-chain", AluChain);
+	//--partition <设计> <共享内存名> <分区号>：由分区仿真的父进程启动
+	if (argc > 1 && std::string(argv[1]) == "--partition") {
+		return DistributedSimulation::Worker(argc, argv);
+	}
+	//--memory：分区仿真示例设计的内存占用
+	if (argc > 1 && std::string(argv[1]) == "--memory") {
+		AluChain().Root->MemoryReport().Print();
+		return 0;
+	}
+	//--equiv：16位行波进位加法器对照逐位加法的参考模型，8位 ALU 对照查找表映射后的网表
+	if (argc > 1 && std::string(argv[1]) == "--equiv") {
+		using Ref = BddManager::Ref;
+		EquivalenceChecker checker;
+		checker.Check(new AdderNbit(16), [](BddManager& m, const std::vector<Ref>& x) {
+			std::vector<Ref> sum = EquivalenceChecker::Add(m, { x.begin(), x.begin() + 16 }, { x.begin() + 16, x.begin() + 32 }, x[32]);
+			sum.resize(16 + 6, BddManager::False);//5个标记位恒为0
+			return sum;
+		}, EquivalenceChecker::Interleave(33, { { 0, 16 }, { 16, 16 } })).Print();
+		Netlist original(new ALU(8)), mapped(new ALU(8));
+		MapLuts(mapped);
+		checker.Check(original, mapped, EquivalenceChecker::Interleave(20, { { 0, 8 }, { 8, 8 } })).Print();
+		//CPU 运行一段循环程序，查找表映射后的编译结果逐周期对照未映射的结果，比较所有仍对应原始位的网络
+		CPU cpu({
+			CPU::Encode(CPU::LDI, 0, 0, 20),
+			CPU::Encode(CPU::LDI, 1, 0, 1),
+			CPU::Encode(CPU::ST, 0, 0, 0),
+			CPU::Encode(CPU::SUB, 0, 1),
+			CPU::Encode(CPU::JNZ, 0, 0, 2),
+			CPU::Encode(CPU::HLT) });
+		FlatEngine plain(cpu), lut(cpu, true);
+		size_t cycles = 0, differences = 0;
+		for (size_t i = 0; i < 9; i++) lut.NetOf(&cpu.Output(i));//CPU 的输出不会被合并
+		while (cycles < 400 && differences == 0) {
+			plain.Step();
+			lut.Step();
+			cycles++;
+			for (const auto& [bit, net] : lut.Program().NetIndex) {
+				if (lut.Value(net) != plain.Value(plain.NetOf(bit))) differences++;
+			}
+		}
+		int halted = lut.Value(lut.NetOf(&cpu.Output(8)));
+		if (differences || halted != 1) {
+			std::print("LUT mapping differs: {} nets at cycle {}, halted {}\n", differences, cycles, halted);
+			return 1;
+		}
+		std::print("LUT mapping matches on {} observable nets over {} cycles\n", lut.Program().NetIndex.size(), cycles);
+		return 0;
+	}
+	//--skip：停机后空转的 CPU 经周期检测跳过，结果对照逐周期执行
+	if (argc > 1 && std::string(argv[1]) == "--skip") {
+		CPU cpu({ CPU::Encode(CPU::LDI, 0, 0, 5), CPU::Encode(CPU::ST, 0, 0, 0), CPU::Encode(CPU::HLT) });
+		FlatEngine plain(cpu), skipped(cpu);
+		CycleSkipper skipper(skipped);
+		const size_t cycles = 200000;
+		plain.Run(cycles);
+		skipper.RunTo(cycles);
+		size_t differences = 0;
+		for (const auto& [bit, net] : skipped.Program().NetIndex) {
+			if (skipped.Value(net) != plain.Value(plain.NetOf(bit))) differences++;
+		}
+		const CycleSkipper::Stats& stats = skipper.Statistics();
+		if (differences || skipped.Value(skipped.NetOf(&cpu.Output(8))) != 1 || stats.Skipped == 0) {
+			std::print("Idle CPU skipping differs: {} nets, executed {}, skipped {}\n", differences, stats.Executed, stats.Skipped);
+			return 1;
+		}
+		std::print("Idle CPU: executed {} of {} cycles, period {}, all {} nets match\n", stats.Executed, cycles, stats.Period, skipped.Program().NetIndex.size());
+		return 0;
+	}
+	//--replace：分区仿真示例设计运行一段后原地替换全部 AdderNbit，与整体重建的时间对比
+	if (argc > 1 && std::string(argv[1]) == "--replace") {
+		auto begin = std::chrono::steady_clock::now();
+		circuit* design = AluChain().Root;
+		design->Prepare();
+		auto built = std::chrono::steady_clock::now();
+		design->Run(100);
+		auto start = std::chrono::steady_clock::now();
+		size_t replaced = design->ReplaceAll([](Unit& u) { return dynamic_cast<AdderNbit*>(&u) != nullptr; },
+			[](Unit&) -> Unit* { return new AdderNbit(16); });
+		auto end = std::chrono::steady_clock::now();
+		design->Run(100);
+		std::print("Full rebuild {:.3f} ms, replaced {} adders in {:.3f} ms, cycle {}\n",
+			std::chrono::duration<double, std::milli>(built - begin).count(), replaced,
+			std::chrono::duration<double, std::milli>(end - start).count(), design->Cycle());
+		return 0;
+	}
+	//--distributed [周期数]：多进程运行分区仿真示例
+	if (argc > 1 && std::string(argv[1]) == "--distributed") {
+		DistributedSimulation sim("alu-chain");
+		sim.Run(argc > 2 ? std::stoul(argv[2]) : 100000).Print();
+		return 0;
+	}
+	//--bench-cpu：测量CPU模型的指令吞吐量
+	if (argc > 1 && std::string(argv[1]) == "--bench-cpu") {
+		CPU::Benchmark();
+		return 0;
+	}
+	//--monitor [名字]：连接正在运行的模拟，显示共享内存中的运行指标
+	if (argc > 1 && std::string(argv[1]) == "--monitor") {
+		MetricsReader::Monitor(argc > 2 ? argv[2] : "LogicElecMetrics");
+		return 0;
+	}
 
-int main() {
 	ManualInputNbitBlockByBit* input = new ManualInputNbitBlockByBit(16);
 	input->Name = "Op";
 	circuit* c = new circuit();
@@ -10,24 +151,27 @@ int main() {
 	inputB->Name = "B";
 	ALU* alu = new ALU(16);
 
-	for (size_t index = 0; index < 16; index++) {
-		inputA->Connect(index, alu, index);
-		inputB->Connect(index, alu, index + 16);
-	}
-
-	for (size_t index = 0; index < 3; index++) {
-		input->Connect(index + 13, alu, index + 33);
-	}
+	inputA->ConnectBus(0, alu->Bus(0, 16));
+	inputB->ConnectBus(0, alu->Bus(16, 16));
+	input->ConnectBus(13, alu->Bus(33, 3));
 
 	SignedMeasureNbit* measure = new SignedMeasureNbit(16);
-	for (size_t index = 0; index < 16; index++) {
-		alu->Connect(index, measure, index);
-	}
+	alu->ConnectBus(0, measure->Bus(0, 16));
 
 	c->AddUnit(inputA).AddUnit(inputB).AddUnit(input)
 		.AddUnit(alu).AddUnit(measure);
 
-	while (1) {
-		c->Excute();
+	//--hz <频率>：按目标频率运行，默认不限速；线路静止且没有输入时阻塞等待，不占满CPU
+	double hz = 0;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) == "--hz") hz = std::stod(argv[i + 1]);
+	}
+	//交互运行每个周期都很慢，逐周期发布指标
+	MetricsPublisher metrics(*c, "LogicElecMetrics", 1);
+	for (size_t i = 0; i < 16; i++) {
+		metrics.AddProbe("result[" + std::to_string(i) + "]", &alu->Output(i));
 	}
+	RealTimeRunner runner(*c, hz);
+	runner.Run();
+	runner.Print();
 }
\ No newline at end of file
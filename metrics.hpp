@@ -0,0 +1,210 @@
+#pragma once
+
+#include"elec.hpp"
+#include<atomic>
+#include<cstring>
+
+//运行指标的共享内存布局：周期数、速度、自定义计数（例如队列深度）和选定网络的值
+//固定大小、无指针，写端和读端可以是不同进程
+struct MetricsData {
+	static constexpr uint32_t MagicValue = 0x544D454C;//"LEMT"
+	static constexpr size_t MaxProbes = 64;
+	static constexpr size_t MaxGauges = 16;
+	static constexpr size_t NameLength = 32;
+
+	uint32_t Magic;
+	uint32_t ProbeCount;
+	uint32_t GaugeCount;
+	uint32_t Running;           //写端退出时清零
+	uint64_t Cycle;
+	uint64_t Publishes;
+	double CyclesPerSecond;     //最近一个发布间隔内的速度
+	double ElapsedSeconds;
+	char ProbeNames[MaxProbes][NameLength];
+	int8_t ProbeValues[MaxProbes];//0/1，-1表示高阻
+	char GaugeNames[MaxGauges][NameLength];
+	int64_t GaugeValues[MaxGauges];
+};
+
+//顺序锁：写端写之前和写完之后各把序号加一，序号为奇数表示正在写；
+//读端复制数据前后序号相同且为偶数才算读到一致的快照，否则重试。写端从不等待读端
+struct MetricsBlock {
+	std::atomic<uint32_t> Sequence;
+	MetricsData Data;
+};
+
+inline std::string MetricsMappingName(const std::string& name) {
+	return "Local\\" + name;
+}
+
+//发布端：挂到线路的周期回调上，每 PublishEvery 个周期写一次共享内存
+class MetricsPublisher {
+public:
+	size_t PublishEvery;
+
+private:
+	circuit& target;
+	size_t hook = 0;//线路上附加周期回调的编号
+	HANDLE mapping = nullptr;
+	MetricsBlock* block = nullptr;
+	std::vector<const Bit*> probes;
+	std::vector<std::function<int64_t()>> gauges;
+	uint64_t cycles = 0;
+	uint64_t lastCycles = 0;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point lastTime;
+
+	static void CopyName(char* to, const std::string& name) {
+		size_t n = std::min(name.size(), MetricsData::NameLength - 1);
+		std::memcpy(to, name.data(), n);
+		to[n] = 0;
+	}
+
+	void Begin() {
+		block->Sequence.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	void End() {
+		block->Sequence.fetch_add(1, std::memory_order_release);
+	}
+
+public:
+	//name 为共享内存名（不含 Local\ 前缀）；监视器用同一个名字打开
+	explicit MetricsPublisher(circuit& c, const std::string& name = "LogicElecMetrics", size_t publishEvery = 4096)
+		: PublishEvery(publishEvery ? publishEvery : 1), target(c) {
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, DWORD(sizeof(MetricsBlock)),
+			MetricsMappingName(name).c_str());
+		if (!mapping) throw std::runtime_error("Cannot create shared memory " + name);
+		block = static_cast<MetricsBlock*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(MetricsBlock)));
+		if (!block) {
+			CloseHandle(mapping);
+			throw std::runtime_error("Cannot map shared memory " + name);
+		}
+		Begin();
+		std::memset(&block->Data, 0, sizeof(MetricsData));
+		block->Data.Magic = MetricsData::MagicValue;
+		block->Data.Running = 1;
+		End();
+		start = lastTime = std::chrono::steady_clock::now();
+		hook = target.AddCycleHook([this](circuit&) {
+			if (++cycles % PublishEvery == 0) Publish();
+		});
+	}
+
+	~MetricsPublisher() {
+		target.RemoveCycleHook(hook);
+		Begin();
+		block->Data.Running = 0;
+		End();
+		UnmapViewOfFile(block);
+		CloseHandle(mapping);
+	}
+
+	MetricsPublisher(const MetricsPublisher&) = delete;
+	MetricsPublisher& operator=(const MetricsPublisher&) = delete;
+
+	//选定要导出的网络，最多 MaxProbes 个
+	void AddProbe(const std::string& name, const Bit* bit) {
+		if (probes.size() >= MetricsData::MaxProbes) throw std::out_of_range("Too many probes");
+		Begin();
+		CopyName(block->Data.ProbeNames[probes.size()], name);
+		block->Data.ProbeCount = uint32_t(probes.size() + 1);
+		End();
+		probes.push_back(bit);
+	}
+
+	//自定义计数，发布时求值，例如事件队列深度
+	void AddGauge(const std::string& name, std::function<int64_t()> read) {
+		if (gauges.size() >= MetricsData::MaxGauges) throw std::out_of_range("Too many gauges");
+		Begin();
+		CopyName(block->Data.GaugeNames[gauges.size()], name);
+		block->Data.GaugeCount = uint32_t(gauges.size() + 1);
+		End();
+		gauges.push_back(std::move(read));
+	}
+
+	//写一次快照，由周期回调调用，也可以手动调用
+	void Publish() {
+		auto now = std::chrono::steady_clock::now();
+		double interval = std::chrono::duration<double>(now - lastTime).count();
+		MetricsData& d = block->Data;
+		Begin();
+		d.Cycle = cycles;
+		d.Publishes++;
+		d.CyclesPerSecond = interval > 0 ? double(cycles - lastCycles) / interval : 0;
+		d.ElapsedSeconds = std::chrono::duration<double>(now - start).count();
+		for (size_t i = 0; i < probes.size(); i++) {
+			d.ProbeValues[i] = probes[i]->isHighZ() ? -1 : int8_t(probes[i]->isOne());
+		}
+		for (size_t i = 0; i < gauges.size(); i++) d.GaugeValues[i] = gauges[i]();
+		End();
+		lastTime = now;
+		lastCycles = cycles;
+	}
+};
+
+//读取端：只读映射，按顺序锁复制快照，不加锁、不影响写端
+class MetricsReader {
+private:
+	HANDLE mapping = nullptr;
+	const MetricsBlock* block = nullptr;
+
+public:
+	explicit MetricsReader(const std::string& name = "LogicElecMetrics") {
+		mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, MetricsMappingName(name).c_str());
+		if (!mapping) throw std::runtime_error("No simulation is publishing metrics as " + name);
+		block = static_cast<const MetricsBlock*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(MetricsBlock)));
+		if (!block) {
+			CloseHandle(mapping);
+			throw std::runtime_error("Cannot map shared memory " + name);
+		}
+	}
+
+	~MetricsReader() {
+		UnmapViewOfFile(block);
+		CloseHandle(mapping);
+	}
+
+	MetricsReader(const MetricsReader&) = delete;
+	MetricsReader& operator=(const MetricsReader&) = delete;
+
+	//读到一致的快照返回 true；写端一直在写时重试 attempts 次后放弃，由调用者稍后再读
+	bool Read(MetricsData& out, int attempts = 100) const {
+		for (int i = 0; i < attempts; i++) {
+			uint32_t before = block->Sequence.load(std::memory_order_acquire);
+			if (before & 1) continue;
+			std::memcpy(&out, &block->Data, sizeof(MetricsData));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint32_t after = block->Sequence.load(std::memory_order_relaxed);
+			if (before == after) return out.Magic == MetricsData::MagicValue;
+		}
+		return false;
+	}
+
+	static void Print(const MetricsData& d) {
+		std::print("cycle {}  {:.0f} cycles/s  elapsed {:.1f} s  publishes {}{}\n",
+			d.Cycle, d.CyclesPerSecond, d.ElapsedSeconds, d.Publishes, d.Running ? "" : "  (stopped)");
+		for (uint32_t i = 0; i < d.GaugeCount && i < MetricsData::MaxGauges; i++) {
+			std::print("  {:<24} {}\n", d.GaugeNames[i], d.GaugeValues[i]);
+		}
+		for (uint32_t i = 0; i < d.ProbeCount && i < MetricsData::MaxProbes; i++) {
+			int v = d.ProbeValues[i];
+			std::print("  {:<24} {}\n", d.ProbeNames[i], v == -1 ? "Z" : std::to_string(v));
+		}
+	}
+
+	//监视器：每 intervalMs 毫秒显示一次，直到按键或写端退出
+	static void Monitor(const std::string& name = "LogicElecMetrics", int intervalMs = 500) {
+		MetricsReader reader(name);
+		MetricsData d;
+		while (true) {
+			if (reader.Read(d)) {
+				Print(d);
+				if (!d.Running) return;
+			}
+			if (GetInputNonBlocking() != -1) return;
+			std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+		}
+	}
+};
@@ -0,0 +1,345 @@
+﻿#pragma once
+
+#include"elec.hpp"
+#include<cstdint>
+#include<map>
+
+//扁平网表：把线路层次展开成位级基本门
+//门按原层次执行顺序排列，逐个执行与 circuit::Excute() 结果一致
+//读取输入时只看"是否为1"，与 Node::Value() 的线或解析相同（高阻按0读取）
+class Netlist {
+public:
+	enum class Op : uint8_t {
+		And,    // out = a & b
+		Or,     // out = a | b
+		Resolve,// 多驱动输入的线或解析，运算同 Or
+		Xor,    // out = a ^ b
+		Not,    // out = !a
+		Buf,    // out = a
+		Const1, // out = 1
+		Tri,    // out = en ? d : 高阻      in: d, en
+		Dec3,   // out = ({c,b,a} == aux)    in: a, b, c
+		Latch,  // en 为1时锁存 d           in: en, d, 状态槽
+		Dff,    // 上升沿采样 d              in: d, clk, 状态槽
+		Opaque, // 无法展开的单元，直接调用 Do()   in[0]: Opaques 下标
+		Lut,    // 查找表，由 MapLuts 生成        in[0]: Luts 下标
+	};
+
+	struct Gate {
+		Op op;
+		uint8_t aux = 0;
+		uint32_t in[3] = { 0, 0, 0 };
+		uint32_t out = 0;
+		Unit* unit = nullptr;//来源单元
+	};
+
+	//无法展开的单元及其读写的网络
+	struct OpaqueUnit {
+		Unit* unit;
+		std::vector<uint32_t> inNets;
+		std::vector<uint32_t> outNets;
+	};
+
+	//查找表：最多6个输入，table 的第 i 位是输入组合 i（in[0] 为最低位）的输出，未用的输入为常0网络
+	struct Lut {
+		uint32_t in[6];
+		uint8_t count;
+		uint64_t table;
+	};
+
+	static constexpr uint32_t Zero = 0;//0号网络恒为0
+
+	std::vector<Gate> Gates;
+	std::vector<OpaqueUnit> Opaques;
+	std::vector<Lut> Luts;
+	std::vector<Bit*> NetBits;       //网络对应的原始位，中间网络为 nullptr
+	std::vector<Unit*> NetDriver;    //最后写入该网络的单元
+	std::vector<uint32_t> Inputs;    //根单元的输入网络
+	std::vector<uint32_t> Outputs;   //根单元的输出网络
+	std::vector<uint32_t> Observed;  //顶层线路自身的输出和命名网络，工艺映射时不合并
+	size_t StateCount = 0;           //Dff/Latch 状态槽数量
+
+	//展开一个顶层线路
+	explicit Netlist(circuit& c) {
+		NewNet(nullptr);
+		Flatten(c);
+		if (Unit* root = dynamic_cast<Unit*>(&c)) {
+			for (auto& node : root->Outputs) Observe(node.Output);
+		}
+		for (auto& [name, bit] : c.namedNets) Observe(bit);
+	}
+
+	//展开一个单元，单元的输入输出作为网表的边界
+	explicit Netlist(Unit* root) {
+		NewNet(nullptr);
+		for (auto& node : root->Inputs) {
+			Inputs.push_back(BoundaryNet(node));
+		}
+		Visit(root);
+		for (auto& node : root->Outputs) {
+			Outputs.push_back(NetOf(node.Output));
+		}
+	}
+
+	size_t NetCount() const { return NetBits.size(); }
+
+	bool HasState() const { return StateCount > 0; }
+
+	//已有网络的编号，不存在时新建
+	uint32_t NetOf(Bit* bit) {
+		auto it = netIndex.find(bit);
+		if (it != netIndex.end()) return it->second;
+		uint32_t net = NewNet(bit);
+		netIndex.emplace(bit, net);
+		return net;
+	}
+
+	//网络不再对应原始位（例如被合并进查找表后不再写入），之后按原始位查找不到它
+	void Unbind(uint32_t net) {
+		if (!NetBits[net]) return;
+		netIndex.erase(NetBits[net]);
+		NetBits[net] = nullptr;
+	}
+
+	//门读取的输入个数
+	static size_t Arity(Op op) {
+		switch (op) {
+		case Op::Const1:
+		case Op::Opaque:
+		case Op::Lut: return 0;
+		case Op::Not:
+		case Op::Buf: return 1;
+		case Op::Dec3:
+		case Op::Latch:
+		case Op::Dff: return op == Op::Dec3 ? 3 : 2;
+		default: return 2;
+		}
+	}
+
+	//按字并行计算查找表，每一位是一个独立的电路
+	static uint64_t EvalLutWord(const Lut& lut, const uint64_t* w) {
+		uint64_t t[64];
+		size_t size = size_t(1) << lut.count;
+		for (size_t m = 0; m < size; m++) t[m] = (lut.table >> m & 1) ? ~uint64_t(0) : 0;
+		for (size_t k = 0; k < lut.count; k++) {
+			uint64_t x = w[lut.in[k]];
+			size = size / 2;
+			for (size_t j = 0; j < size; j++) t[j] = (x & t[2 * j + 1]) | (~x & t[2 * j]);
+		}
+		return t[0];
+	}
+
+	//网络的初始值（恒定网络取原始位的值）
+	bool InitialValue(uint32_t net) const {
+		return NetBits[net] && NetBits[net]->isOne();
+	}
+
+private:
+	struct Resolved {
+		uint32_t net;
+		size_t at;//解析门生成时的门数量
+	};
+	std::unordered_map<Bit*, uint32_t> netIndex;
+	std::map<std::vector<uint32_t>, Resolved> resolved;//多驱动输入的解析结果，按驱动集合去重
+	std::vector<size_t> lastWrite;//每个网络最后一次被写入时的门数量
+
+	uint32_t NewNet(Bit* bit) {
+		NetBits.push_back(bit);
+		NetDriver.push_back(nullptr);
+		lastWrite.push_back(0);
+		return uint32_t(NetBits.size() - 1);
+	}
+
+	uint32_t Emit(Op op, uint32_t a, uint32_t b, uint32_t out, Unit* unit, uint8_t aux = 0) {
+		Gate g;
+		g.op = op;
+		g.aux = aux;
+		g.in[0] = a;
+		g.in[1] = b;
+		g.out = out;
+		g.unit = unit;
+		Gates.push_back(g);
+		NetDriver[out] = unit;
+		lastWrite[out] = Gates.size();
+		return out;
+	}
+
+	uint32_t Temp() { return NewNet(nullptr); }
+
+	void Observe(Bit* bit) {
+		auto it = netIndex.find(bit);
+		if (it != netIndex.end()) Observed.push_back(it->second);
+	}
+
+	std::vector<uint32_t> DriverNets(Unit::Node& node) {
+		std::vector<uint32_t> drivers;
+		for (Bit* bit : node.Inputs) {
+			drivers.push_back(NetOf(bit));
+		}
+		std::sort(drivers.begin(), drivers.end());
+		drivers.erase(std::unique(drivers.begin(), drivers.end()), drivers.end());
+		return drivers;
+	}
+
+	//根单元输入：由外部给定，不生成解析门
+	uint32_t BoundaryNet(Unit::Node& node) {
+		if (node.Inputs.empty()) return NetOf(node.Output);
+		std::vector<uint32_t> drivers = DriverNets(node);
+		if (drivers.size() == 1) return drivers[0];
+		auto it = resolved.find(drivers);
+		if (it != resolved.end()) return it->second.net;
+		uint32_t net = Temp();
+		resolved.emplace(std::move(drivers), Resolved{ net, 0 });
+		return net;
+	}
+
+	//单元内部输入：多个驱动时生成线或
+	uint32_t InputNet(Unit::Node& node, Unit* unit) {
+		if (node.Inputs.empty()) return NetOf(node.Output);
+		std::vector<uint32_t> drivers = DriverNets(node);
+		if (drivers.size() == 1) return drivers[0];
+		auto it = resolved.find(drivers);
+		if (it != resolved.end()) {
+			//边界输入由外部给定
+			if (it->second.at == 0) return it->second.net;
+			//驱动在上次解析后被改写过才需要重新解析，保持与逐单元执行一致
+			bool stale = false;
+			for (uint32_t d : drivers) {
+				if (lastWrite[d] > it->second.at) stale = true;
+			}
+			if (stale) {
+				Resolve(drivers, it->second.net, unit);
+				it->second.at = Gates.size();
+			}
+			return it->second.net;
+		}
+		uint32_t net = Temp();
+		Resolve(drivers, net, unit);
+		resolved.emplace(std::move(drivers), Resolved{ net, Gates.size() });
+		return net;
+	}
+
+	void Resolve(const std::vector<uint32_t>& drivers, uint32_t out, Unit* unit) {
+		uint32_t acc = drivers[0];
+		for (size_t i = 1; i < drivers.size(); i++) {
+			uint32_t next = (i + 1 == drivers.size()) ? out : Temp();
+			acc = Emit(Op::Resolve, acc, drivers[i], next, unit);
+		}
+	}
+
+	uint32_t In(Unit* u, size_t index) { return InputNet(u->Inputs[index], u); }
+	uint32_t Out(Unit* u, size_t index) { return NetOf(u->Outputs[index].Output); }
+
+	//多输入与/或，按 Do() 中的顺序逐个累积
+	void Chain(Op op, Unit* u, size_t bit, size_t width) {
+		size_t count = u->Inputs.size() / width;
+		uint32_t out = Out(u, bit);
+		if (count == 1) {
+			Emit(Op::Buf, In(u, bit), 0, out, u);
+			return;
+		}
+		uint32_t acc = In(u, bit);
+		for (size_t j = 1; j < count; j++) {
+			uint32_t next = (j + 1 == count) ? out : Temp();
+			acc = Emit(op, acc, In(u, bit + j * width), next, u);
+		}
+	}
+
+	void Bitwise(Op op, Unit* u) {
+		size_t n = u->Outputs.size();
+		for (size_t i = 0; i < n; i++) {
+			Emit(op, In(u, i), op == Op::Not ? 0 : In(u, i + n), Out(u, i), u);
+		}
+	}
+
+	void Decoder(Unit* u, size_t selects) {
+		uint32_t sel[3] = { Zero, Zero, Zero };
+		for (size_t i = 0; i < selects; i++) sel[i] = In(u, i);
+		for (size_t k = 0; k < u->Outputs.size(); k++) {
+			Emit(Op::Dec3, sel[0], sel[1], Out(u, k), u, uint8_t(k));
+			Gates.back().in[2] = sel[2];
+		}
+	}
+
+	void Flatten(circuit& c) {
+		c.Prepare();
+		for (Unit* u : c.comboUnits) Visit(u);
+		for (Unit* u : c.seqUnits) Visit(u);
+	}
+
+	void Visit(Unit* u) {
+		circuit* sub = dynamic_cast<circuit*>(u);
+		if (sub && sub->IsStructural()) {
+			Flatten(*sub);
+			return;
+		}
+		if (dynamic_cast<AndGate*>(u) || dynamic_cast<AndGate8bit*>(u) || dynamic_cast<AndGateNbit*>(u)) {
+			Bitwise(Op::And, u);
+		}
+		else if (dynamic_cast<OrGate*>(u) || dynamic_cast<OrGate8bit*>(u) || dynamic_cast<OrGateNBit*>(u)) {
+			Bitwise(Op::Or, u);
+		}
+		else if (dynamic_cast<XorGate*>(u) || dynamic_cast<XorGate8bit*>(u) || dynamic_cast<XorGateNBit*>(u)) {
+			Bitwise(Op::Xor, u);
+		}
+		else if (dynamic_cast<NotGate*>(u) || dynamic_cast<NotGate8bit*>(u) || dynamic_cast<NotGateNBit*>(u)) {
+			Bitwise(Op::Not, u);
+		}
+		else if (dynamic_cast<AndGate8bit_nInput*>(u) || dynamic_cast<AndGateNBit_nInput*>(u)) {
+			for (size_t i = 0; i < u->Outputs.size(); i++) Chain(Op::And, u, i, u->Outputs.size());
+		}
+		else if (dynamic_cast<OrGate8bit_nInput*>(u) || dynamic_cast<OrGateNBit_nInput*>(u)) {
+			for (size_t i = 0; i < u->Outputs.size(); i++) Chain(Op::Or, u, i, u->Outputs.size());
+		}
+		else if (dynamic_cast<Bus8bit*>(u)) {
+			for (size_t i = 0; i < u->Outputs.size(); i++) Emit(Op::Buf, In(u, i), 0, Out(u, i), u);
+		}
+		else if (dynamic_cast<TriStateGate*>(u)) {
+			Emit(Op::Tri, In(u, 0), In(u, 1), Out(u, 0), u);
+		}
+		else if (dynamic_cast<Mux2to4*>(u)) {
+			Decoder(u, 2);
+		}
+		else if (dynamic_cast<Mux3to8*>(u)) {
+			Decoder(u, 3);
+		}
+		else if (dynamic_cast<PullUp*>(u)) {
+			Emit(Op::Const1, 0, 0, Out(u, 0), u);
+		}
+		else if (dynamic_cast<PullDown*>(u)) {
+			Emit(Op::Buf, Zero, 0, Out(u, 0), u);
+		}
+		else if (dynamic_cast<Clock*>(u)) {
+			uint32_t out = Out(u, 0);
+			Emit(Op::Not, out, 0, out, u);
+		}
+		else if (dynamic_cast<StoreUnit*>(u)) {
+			Emit(Op::Latch, In(u, 0), In(u, 1), Out(u, 0), u);
+			Gates.back().in[2] = uint32_t(StateCount++);
+		}
+		else if (dynamic_cast<DFlipFlop*>(u)) {
+			Emit(Op::Dff, In(u, 0), In(u, 1), Out(u, 0), u);
+			Gates.back().in[2] = uint32_t(StateCount++);
+		}
+		else {
+			OpaqueUnit opaque{ u, {}, {} };
+			for (auto& node : u->Inputs) {
+				if (node.Inputs.empty()) opaque.inNets.push_back(NetOf(node.Output));
+				for (Bit* bit : node.Inputs) opaque.inNets.push_back(NetOf(bit));
+			}
+			for (size_t i = 0; i < u->Outputs.size(); i++) {
+				opaque.outNets.push_back(Out(u, i));
+			}
+			Gate g;
+			g.op = Op::Opaque;
+			g.in[0] = uint32_t(Opaques.size());
+			g.unit = u;
+			Gates.push_back(g);
+			for (uint32_t net : opaque.outNets) {
+				NetDriver[net] = u;
+				lastWrite[net] = Gates.size();
+			}
+			Opaques.push_back(std::move(opaque));
+		}
+	}
+};
@@ -0,0 +1,541 @@
+#pragma once
+
+#include"elec.hpp"
+#include<atomic>
+#include<memory>
+
+//组相联 LRU 缓存模型，用单元访问的地址估计每周期的缓存缺失
+class CacheModel {
+private:
+	size_t ways;
+	size_t sets;
+	std::vector<uintptr_t> tags;    //每组 ways 个，按最近使用排序
+	std::vector<uint8_t> used;
+public:
+	static constexpr size_t LineBytes = 64;
+
+	size_t Accesses = 0;
+	size_t Misses = 0;
+
+	CacheModel(size_t bytes = 256 * 1024, size_t associativity = 8)
+		: ways(associativity), sets(std::max<size_t>(1, bytes / LineBytes / associativity)) {
+		tags.assign(sets * ways, 0);
+		used.assign(sets, 0);
+	}
+
+	void Access(uintptr_t line) {
+		Accesses++;
+		uintptr_t* set = tags.data() + (line % sets) * ways;
+		uint8_t& count = used[line % sets];
+		for (size_t i = 0; i < count; i++) {
+			if (set[i] == line) {
+				std::rotate(set, set + i, set + i + 1);
+				return;
+			}
+		}
+		Misses++;
+		if (count < ways) count++;
+		std::rotate(set, set + count - 1, set + count);
+		set[0] = line;
+	}
+};
+
+//把大线路展开到叶单元（门和行为级单元），按读写的位建立依赖图，分成缓存大小、跨簇网络少的簇，按簇依次执行
+//同一条数据通路上的门连续执行，访问的位集中在少数缓存行里；也可以把簇分配给固定核心的线程并行执行
+//依赖图保持原执行顺序中每个位的读写先后（写后读、读后写、写后写），因此任何符合依赖的顺序结果都与 Excute() 相同
+//顶层的时序单元在所有簇之后按原顺序执行；子线路的周期计数和周期回调不再推进
+//分簇之后用 AddUnit() 修改线路会在 Step() 中报错；Replace() 不会被检测到，替换后需要重新构造 Partitioner
+class Partitioner {
+public:
+	struct Cluster {
+		std::vector<Unit*> Units;       //叶单元，按执行顺序
+		size_t Bytes = 0;               //簇内单元访问的缓存行总大小（估计）
+		std::vector<size_t> Depends;    //依赖的其他簇
+		size_t Level = 0;               //依赖链上的深度
+	};
+
+	struct Report {
+		size_t Units = 0;
+		size_t Gates = 0;               //每周期执行的叶单元数
+		size_t Clusters = 0;
+		size_t CutNetsInitial = 0;      //按拓扑序直接切分时的跨簇网络
+		size_t CutNets = 0;             //贪心调整边界之后
+		double MissesBefore = 0;        //每周期缓存缺失（模型估计）
+		double MissesAfter = 0;
+		double EvalsBefore = 0;         //每秒门计算次数
+		double EvalsAfter = 0;
+
+		void Print() const {
+			std::print("Partition: {} units, {} gates, {} clusters, {} cut nets ({} before refinement)\n",
+				Units, Gates, Clusters, CutNets, CutNetsInitial);
+			std::print("  cache misses/cycle: {:.0f} -> {:.0f}\n", MissesBefore, MissesAfter);
+			std::print("  gate evals/sec:     {:.3e} -> {:.3e}\n", EvalsBefore, EvalsAfter);
+		}
+	};
+
+private:
+	circuit& target;
+	std::vector<Cluster> clusters;
+	size_t cutNets = 0;
+	size_t initialCutNets = 0;
+	std::vector<std::pair<Unit::Node*, Bit*>> privateInputs;//共用解析位的输入节点 -> 当前未装上的位
+	std::vector<std::unique_ptr<Bit>> privateBits;
+	static constexpr size_t MaxShift = 256;//调整边界时一次最多移动的叶单元数
+
+	//并行执行
+	std::vector<std::vector<size_t>> assignment;//线程 -> 按层次排列的簇
+	std::vector<std::thread> workers;
+	std::unique_ptr<std::atomic<uint64_t>[]> done;//簇最后完成的周期
+	std::atomic<uint64_t> generation{ 0 };
+	std::atomic<size_t> running{ 0 };
+	std::atomic<bool> stopping{ false };
+
+	static void Wait(const std::atomic<uint64_t>& flag, uint64_t value) {
+		for (unsigned spin = 0; flag.load(std::memory_order_acquire) < value; spin++) {
+			if (spin > 64) std::this_thread::yield();
+		}
+	}
+
+	void RunClusters(const std::vector<size_t>& list, uint64_t gen) {
+		for (size_t ci : list) {
+			for (size_t d : clusters[ci].Depends) Wait(done[d], gen);
+			for (Unit* u : clusters[ci].Units) u->Do();
+			done[ci].store(gen, std::memory_order_release);
+		}
+	}
+
+	void WorkerLoop(size_t index) {
+		uint64_t seen = 0;
+		for (;;) {
+			Wait(generation, seen + 1);
+			if (stopping.load(std::memory_order_acquire)) return;
+			seen = generation.load(std::memory_order_acquire);
+			RunClusters(assignment[index], seen);
+			running.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+
+	void Stop() {
+		if (workers.empty()) return;
+		stopping.store(true, std::memory_order_release);
+		generation.fetch_add(1, std::memory_order_acq_rel);
+		for (auto& t : workers) t.join();
+		workers.clear();
+		stopping.store(false);
+	}
+
+	//按执行顺序列出叶单元（行为级单元和门）
+	static void Leaves(Unit* u, std::vector<Unit*>& out) {
+		circuit* sub = dynamic_cast<circuit*>(u);
+		if (sub && sub->IsStructural()) {
+			for (Unit* v : sub->comboUnits) Leaves(v, out);
+			for (Unit* v : sub->seqUnits) Leaves(v, out);
+			return;
+		}
+		out.push_back(u);
+	}
+
+	//叶单元执行时访问的缓存行：单元对象、节点数组和读写的位
+	static void Lines(Unit* u, std::vector<uintptr_t>& out) {
+		auto line = [&](const void* p) { out.push_back(reinterpret_cast<uintptr_t>(p) / CacheModel::LineBytes); };
+		line(u);
+		line(u->Inputs.data());
+		for (auto& node : u->Inputs) {
+			if (!node.Inputs.empty()) line(node.Inputs.data());
+			for (Bit* bit : node.Inputs) line(bit);
+			line(node.Output);
+		}
+		line(u->Outputs.data());
+		for (auto& node : u->Outputs) line(node.Output);
+	}
+
+	static std::vector<Unit*> ExecutionOrder(circuit& c) {
+		std::vector<Unit*> leaves;
+		for (Unit* u : c.comboUnits) Leaves(u, leaves);
+		for (Unit* u : c.seqUnits) Leaves(u, leaves);
+		return leaves;
+	}
+
+	//SetInput 绑定的子单元与父单元共用输入节点的解析位，各自执行时都会写它
+	//只留给执行顺序中第一个解析的叶单元，其余的改用分簇器自己的位，并行执行时不会有两个线程写同一个位
+	//没有驱动、直接读这个位的节点仍读第一个叶单元解析的结果，依赖图中有对应的写后读
+	void PrivatizeResolvedInputs(const std::vector<Unit*>& leaves) {
+		std::unordered_set<const Bit*> owned;
+		for (Unit* u : leaves) {
+			for (auto& node : u->Inputs) {
+				if (node.Inputs.empty() || !node.Output) continue;
+				if (owned.insert(node.Output).second) continue;
+				privateBits.push_back(std::make_unique<Bit>(*node.Output));
+				privateInputs.push_back({ &node, privateBits.back().get() });
+			}
+		}
+	}
+
+	//私有位只在建图和执行期间装在节点上，离开作用域时换回原来的位，线路在两次执行之间保持原样
+	class PrivateScope {
+		Partitioner& owner;
+	public:
+		explicit PrivateScope(Partitioner& p) : owner(p) { Swap(); }
+		~PrivateScope() { Swap(); }
+		PrivateScope(const PrivateScope&) = delete;
+		PrivateScope& operator=(const PrivateScope&) = delete;
+		void Swap() {
+			for (auto& [node, other] : owner.privateInputs) std::swap(node->Output, other);
+		}
+	};
+
+	//网络（位）与簇的关联：每个网络在哪些簇里被读写，出现在多个簇中即为跨簇网络
+	struct Incidence {
+		std::vector<std::vector<uint32_t>> netsOf;                      //叶单元 -> 读写的网络
+		std::vector<std::vector<std::pair<uint32_t, uint32_t>>> count;  //网络 -> (簇, 该簇内接触它的叶单元数)
+
+		static bool Cut(const std::vector<std::pair<uint32_t, uint32_t>>& c) { return c.size() > 1; }
+
+		void Add(uint32_t leaf, uint32_t cluster) {
+			for (uint32_t e : netsOf[leaf]) {
+				auto& c = count[e];
+				auto it = std::find_if(c.begin(), c.end(), [&](auto& p) { return p.first == cluster; });
+				if (it == c.end()) c.push_back({ cluster, 1 });
+				else it->second++;
+			}
+		}
+
+		void Remove(uint32_t leaf, uint32_t cluster) {
+			for (uint32_t e : netsOf[leaf]) {
+				auto& c = count[e];
+				auto it = std::find_if(c.begin(), c.end(), [&](auto& p) { return p.first == cluster; });
+				if (--it->second == 0) c.erase(it);
+			}
+		}
+
+		//把叶单元从 from 移到 to 后减少的跨簇网络数
+		int Gain(uint32_t leaf, uint32_t from, uint32_t to) const {
+			int gain = 0;
+			for (uint32_t e : netsOf[leaf]) {
+				const auto& c = count[e];
+				size_t distinct = c.size();
+				bool inTo = false;
+				for (auto& [k, n] : c) {
+					if (k == from && n == 1) distinct--;
+					if (k == to) inTo = true;
+				}
+				if (!inTo) distinct++;
+				gain += int(Cut(c)) - int(distinct > 1);
+			}
+			return gain;
+		}
+
+		size_t CutNets() const {
+			size_t n = 0;
+			for (auto& c : count) n += Cut(c);
+			return n;
+		}
+	};
+
+public:
+	//展开并分簇，clusterBytes 一般取每个核心的 L2 大小
+	//先按深度优先的拓扑序（生产者之后紧接着消费者）切成略小于 clusterBytes 的段，
+	//再逐个移动相邻两段之间的边界，只要减少跨簇网络且不超出大小就移动；各簇始终是拓扑序上的连续段，簇之间不会成环
+	explicit Partitioner(circuit& c, size_t clusterBytes = 256 * 1024) : target(c) {
+		c.Prepare();
+		std::vector<Unit*> leaves;
+		for (Unit* u : c.comboUnits) Leaves(u, leaves);
+		PrivatizeResolvedInputs(leaves);
+		PrivateScope scope(*this);
+		const size_t n = leaves.size();
+
+		//按原执行顺序记录每个位最后的写者和此后的读者，得到依赖
+		Incidence inc;
+		inc.netsOf.resize(n);
+		std::unordered_map<const Bit*, uint32_t> netIndex;
+		struct Access {
+			size_t writer = SIZE_MAX;
+			std::vector<size_t> readers;
+		};
+		std::vector<Access> access;
+		std::vector<std::vector<size_t>> preds(n);
+		std::vector<const Bit*> reads, writes;
+		auto net = [&](const Bit* bit) {
+			auto [it, added] = netIndex.emplace(bit, uint32_t(access.size()));
+			if (added) access.emplace_back();
+			return it->second;
+		};
+		for (size_t i = 0; i < n; i++) {
+			reads.clear();
+			writes.clear();
+			for (auto& node : leaves[i]->Inputs) {
+				if (node.Inputs.empty()) reads.push_back(node.Output);
+				else {
+					for (Bit* bit : node.Inputs) reads.push_back(bit);
+					writes.push_back(node.Output);
+				}
+			}
+			for (auto& node : leaves[i]->Outputs) writes.push_back(node.Output);
+			std::vector<uint32_t>& nets = inc.netsOf[i];
+			for (const Bit* bit : reads) {
+				uint32_t e = net(bit);
+				Access& a = access[e];
+				if (a.writer != SIZE_MAX && a.writer != i) preds[i].push_back(a.writer);
+				a.readers.push_back(i);
+				nets.push_back(e);
+			}
+			for (const Bit* bit : writes) {
+				uint32_t e = net(bit);
+				Access& a = access[e];
+				if (a.writer != SIZE_MAX && a.writer != i) preds[i].push_back(a.writer);
+				for (size_t r : a.readers) {
+					if (r != i) preds[i].push_back(r);
+				}
+				a.writer = i;
+				a.readers.clear();
+				nets.push_back(e);
+			}
+			std::sort(preds[i].begin(), preds[i].end());
+			preds[i].erase(std::unique(preds[i].begin(), preds[i].end()), preds[i].end());
+			std::sort(nets.begin(), nets.end());
+			nets.erase(std::unique(nets.begin(), nets.end()), nets.end());
+		}
+		access.clear();
+		inc.count.resize(netIndex.size());
+
+		std::vector<std::vector<size_t>> dependents(n);
+		std::vector<size_t> indegree(n, 0);
+		for (size_t i = 0; i < n; i++) {
+			indegree[i] = preds[i].size();
+			for (size_t p : preds[i]) dependents[p].push_back(i);
+		}
+
+		//每个叶单元占用的缓存行
+		std::vector<size_t> bytes(n);
+		std::vector<uintptr_t> lines;
+		for (size_t i = 0; i < n; i++) {
+			lines.clear();
+			Lines(leaves[i], lines);
+			std::sort(lines.begin(), lines.end());
+			bytes[i] = size_t(std::unique(lines.begin(), lines.end()) - lines.begin()) * CacheModel::LineBytes;
+		}
+
+		//深度优先的拓扑序，按 7/8 的预算切段，给后面的边界调整留出余量
+		std::vector<size_t> ready;
+		for (size_t i = n; i-- > 0;) {
+			if (indegree[i] == 0) ready.push_back(i);
+		}
+		std::vector<uint32_t> order;
+		order.reserve(n);
+		std::vector<size_t> start;      //每段在 order 中的起点
+		std::vector<size_t> segmentBytes;
+		size_t fill = std::max<size_t>(1, clusterBytes / 8 * 7);
+		while (!ready.empty()) {
+			size_t i = ready.back();
+			ready.pop_back();
+			if (start.empty() || (segmentBytes.back() + bytes[i] > fill && start.back() != order.size())) {
+				start.push_back(order.size());
+				segmentBytes.push_back(0);
+			}
+			segmentBytes.back() += bytes[i];
+			order.push_back(uint32_t(i));
+			for (size_t k = dependents[i].size(); k-- > 0;) {
+				size_t d = dependents[i][k];
+				if (--indegree[d] == 0) ready.push_back(d);
+			}
+		}
+		if (order.size() != n) {
+			throw std::runtime_error("Cyclic dependency in combinational logic");
+		}
+		start.push_back(n);
+		size_t segments = segmentBytes.size();
+		for (size_t k = 0; k < segments; k++) {
+			for (size_t j = start[k]; j < start[k + 1]; j++) inc.Add(order[j], uint32_t(k));
+		}
+		initialCutNets = inc.CutNets();
+
+		//贪心调整边界：把边界逐个叶单元地向一侧推，最多 MaxShift 步，保留累计减少跨簇网络最多的位置
+		//单步常常不减少，连续移动几步之后才减少，所以按累计值取最好的前缀
+		auto move = [&](uint32_t leaf, size_t from, size_t to) {
+			inc.Remove(leaf, uint32_t(from));
+			inc.Add(leaf, uint32_t(to));
+			segmentBytes[from] -= bytes[leaf];
+			segmentBytes[to] += bytes[leaf];
+		};
+		//left 为 true 时把第 k-1 段末尾的叶单元移入第 k 段，否则把第 k 段开头的移入第 k-1 段
+		auto shift = [&](size_t k, bool left) {
+			const size_t from = left ? k - 1 : k, to = left ? k : k - 1;
+			int gain = 0, best = 0;
+			size_t steps = 0, bestSteps = 0;
+			while (steps < MaxShift && start[from + 1] - start[from] > 1) {
+				uint32_t leaf = left ? order[start[k] - 1] : order[start[k]];
+				if (segmentBytes[to] + bytes[leaf] > clusterBytes) break;
+				gain += inc.Gain(leaf, uint32_t(from), uint32_t(to));
+				move(leaf, from, to);
+				left ? start[k]-- : start[k]++;
+				if (gain > best) {
+					best = gain;
+					bestSteps = steps + 1;
+				}
+				steps++;
+			}
+			for (; steps > bestSteps; steps--) {
+				left ? start[k]++ : start[k]--;
+				move(left ? order[start[k] - 1] : order[start[k]], to, from);
+			}
+			return bestSteps > 0;
+		};
+		for (int pass = 0; pass < 8; pass++) {
+			bool moved = false;
+			for (size_t k = 1; k < segments; k++) {
+				moved |= shift(k, true);
+				moved |= shift(k, false);
+			}
+			if (!moved) break;
+		}
+		cutNets = inc.CutNets();
+
+		//生成簇和簇之间的依赖；依赖只指向前面的簇，层次按顺序计算
+		std::vector<size_t> clusterOf(n);
+		clusters.resize(segments);
+		for (size_t k = 0; k < segments; k++) {
+			clusters[k].Bytes = segmentBytes[k];
+			for (size_t j = start[k]; j < start[k + 1]; j++) {
+				clusters[k].Units.push_back(leaves[order[j]]);
+				clusterOf[order[j]] = k;
+			}
+		}
+		for (size_t k = 0; k < segments; k++) {
+			Cluster& cl = clusters[k];
+			for (size_t j = start[k]; j < start[k + 1]; j++) {
+				for (size_t p : preds[order[j]]) {
+					size_t from = clusterOf[p];
+					if (from != k) cl.Depends.push_back(from);
+				}
+			}
+			std::sort(cl.Depends.begin(), cl.Depends.end());
+			cl.Depends.erase(std::unique(cl.Depends.begin(), cl.Depends.end()), cl.Depends.end());
+			for (size_t d : cl.Depends) cl.Level = std::max(cl.Level, clusters[d].Level + 1);
+		}
+	}
+
+	~Partitioner() { Stop(); }
+
+	Partitioner(const Partitioner&) = delete;
+	Partitioner& operator=(const Partitioner&) = delete;
+
+	const std::vector<Cluster>& Clusters() const { return clusters; }
+	size_t CutNets() const { return cutNets; }
+	size_t InitialCutNets() const { return initialCutNets; }
+
+	//启动 threads 个线程（含调用线程）并行执行各簇，pin 为 true 时把工作线程固定到各自的核心
+	//簇按依赖深度轮流分配给线程，每个线程每周期只执行自己的簇，数据留在该核心的缓存中
+	//依赖图覆盖了簇之间所有读写同一个位的情况，共用的输入解析位已在构造时分开，不同线程不会同时写同一个位
+	void Start(unsigned threads, bool pin = true) {
+		Stop();
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		threads = unsigned(std::min<size_t>(threads, std::max<size_t>(1, clusters.size())));
+		std::vector<size_t> byLevel(clusters.size());
+		for (size_t i = 0; i < byLevel.size(); i++) byLevel[i] = i;
+		std::stable_sort(byLevel.begin(), byLevel.end(),
+			[&](size_t a, size_t b) { return clusters[a].Level < clusters[b].Level; });
+		assignment.assign(threads, {});
+		for (size_t k = 0; k < byLevel.size(); k++) assignment[k % threads].push_back(byLevel[k]);
+
+		done.reset(new std::atomic<uint64_t>[clusters.size()]);
+		for (size_t i = 0; i < clusters.size(); i++) done[i].store(0);
+		generation.store(0);
+		unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned t = 1; t < threads; t++) {
+			workers.emplace_back(&Partitioner::WorkerLoop, this, size_t(t));
+			if (pin) SetThreadAffinityMask(workers.back().native_handle(), DWORD_PTR(1) << (t % cores % 64));
+		}
+	}
+
+	//执行一个周期：组合部分按簇执行，顶层时序单元在所有簇完成后执行
+	void Step() {
+		if (!target.IsSorted) {
+			throw std::runtime_error("Circuit was modified after partitioning");
+		}
+		{
+			PrivateScope scope(*this);
+			if (workers.empty()) {
+				for (Cluster& cl : clusters) {
+					for (Unit* u : cl.Units) u->Do();
+				}
+			}
+			else {
+				running.store(workers.size(), std::memory_order_release);
+				uint64_t gen = generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+				RunClusters(assignment[0], gen);
+				while (running.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+			}
+		}
+		for (Unit* u : target.seqUnits) u->Do();
+		target.cycle++;
+		target.CycleDone();
+	}
+
+	//连续执行 cycles 个周期，返回累计周期数
+	size_t Run(size_t cycles) {
+		for (size_t i = 0; i < cycles; i++) Step();
+		return target.cycle;
+	}
+
+	//用缓存模型重放一个周期的访问，返回热身后每周期的缺失数
+	static double MissesPerCycle(const std::vector<Unit*>& order, size_t cacheBytes = 256 * 1024) {
+		std::vector<uintptr_t> trace;
+		for (Unit* leaf : order) Lines(leaf, trace);
+		CacheModel cache(cacheBytes);
+		for (uintptr_t line : trace) cache.Access(line);
+		cache.Misses = 0;
+		for (uintptr_t line : trace) cache.Access(line);
+		return double(cache.Misses);
+	}
+
+	//按 Excute() 的顺序
+	static double MissesPerCycle(circuit& c, size_t cacheBytes = 256 * 1024) {
+		c.Prepare();
+		return MissesPerCycle(ExecutionOrder(c), cacheBytes);
+	}
+
+	//按簇的顺序
+	double MissesPerCycle(size_t cacheBytes = 256 * 1024) {
+		PrivateScope scope(*this);
+		std::vector<Unit*> order;
+		for (const Cluster& cl : clusters) order.insert(order.end(), cl.Units.begin(), cl.Units.end());
+		for (Unit* u : target.seqUnits) Leaves(u, order);
+		return MissesPerCycle(order, cacheBytes);
+	}
+
+	//实测每秒门计算次数（会推进线路 cycles 个周期）
+	static double EvalsPerSecond(circuit& c, size_t cycles = 100) {
+		c.Prepare();
+		size_t gates = ExecutionOrder(c).size();
+		auto start = std::chrono::steady_clock::now();
+		c.Run(cycles);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return seconds > 0 ? double(gates) * double(cycles) / seconds : 0;
+	}
+
+	//按簇执行时的每秒门计算次数
+	double EvalsPerSecond(size_t cycles = 100) {
+		size_t gates = ExecutionOrder(target).size();
+		auto start = std::chrono::steady_clock::now();
+		Run(cycles);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return seconds > 0 ? double(gates) * double(cycles) / seconds : 0;
+	}
+
+	//测量、分簇、再测量；返回的分簇器可以继续用于并行执行
+	static std::unique_ptr<Partitioner> Optimize(circuit& c, Report& report,
+		size_t clusterBytes = 256 * 1024, size_t cycles = 100) {
+		c.Prepare();
+		report.Units = c.comboUnits.size() + c.seqUnits.size();
+		report.Gates = ExecutionOrder(c).size();
+		report.MissesBefore = MissesPerCycle(c, clusterBytes);
+		report.EvalsBefore = EvalsPerSecond(c, cycles);
+		auto partitioner = std::make_unique<Partitioner>(c, clusterBytes);
+		report.Clusters = partitioner->Clusters().size();
+		report.CutNetsInitial = partitioner->InitialCutNets();
+		report.CutNets = partitioner->CutNets();
+		report.MissesAfter = partitioner->MissesPerCycle(clusterBytes);
+		report.EvalsAfter = partitioner->EvalsPerSecond(cycles);
+		return partitioner;
+	}
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include"elec.hpp"
+#include<atomic>
+
+//实时运行器：按目标频率推进周期，代替 while (1) c->Excute(); 的空转
+//静止：所有网络的值与 Period 个周期之前相同（默认2，时钟翻转两次回到原状态），并且没有待处理的输入。
+//确定性的线路此后只会重复同样的状态，运行器阻塞在输入通知或定时器上，直到有输入或 WakeInterval 到期
+//行为级单元若有不反映在输出上的内部状态，可以设置 WakeInterval 定期唤醒
+class RealTimeRunner {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats {
+		double TargetHz = 0;     //0 表示不限速
+		double AchievedHz = 0;   //模拟周期（含静止期间跳过的周期）/ 墙钟时间
+		double BusyHz = 0;       //实际执行的周期 / 非静止时间
+		uint64_t Executed = 0;
+		uint64_t Skipped = 0;    //静止期间按目标频率本应经过的周期
+		uint64_t Wakeups = 0;    //从静止中恢复的次数
+		uint64_t Overruns = 0;   //落后目标超过 MaxLag 而放弃追赶的次数
+		double WallSeconds = 0;
+		double IdleSeconds = 0;
+	};
+
+	size_t Period;                                     //静止判定比较的周期间隔
+	std::chrono::milliseconds PollInterval{ 10 };      //静止时查询没有通知线程的输入源（键盘）的间隔
+	std::chrono::milliseconds WakeInterval{ 0 };       //静止超过该时间强制执行一个周期，0 表示只由输入唤醒
+	std::chrono::milliseconds MaxLag{ 100 };           //落后超过该时间不再补跑，重新对齐节拍
+
+private:
+	circuit& target;
+	double hz;
+	std::vector<const Bit*> nets;
+	std::vector<Unit*> sources;
+	std::vector<uint8_t> history;   //最近 Period 个周期的网络值，按周期轮转
+	size_t filled = 0;              //自上次唤醒后记录了几个周期
+	std::atomic<bool> stopping{ false };
+	Stats stats;
+	Clock::duration wall{};
+	Clock::duration idle{};
+
+	void Walk(Unit* u, std::unordered_set<const Bit*>& seen) {
+		circuit* sub = dynamic_cast<circuit*>(u);
+		if (sub && sub->IsStructural()) {
+			Visit(*sub, seen);
+			return;
+		}
+		if (u->IsInputSource()) sources.push_back(u);
+		for (auto& node : u->Outputs) {
+			if (seen.insert(node.Output).second) nets.push_back(node.Output);
+		}
+	}
+
+	void Visit(circuit& c, std::unordered_set<const Bit*>& seen) {
+		for (Unit* u : c.comboUnits) Walk(u, seen);
+		for (Unit* u : c.seqUnits) Walk(u, seen);
+	}
+
+	bool AnyPendingInput() {
+		for (Unit* u : sources) {
+			if (u->HasPendingInput()) return true;
+		}
+		return false;
+	}
+
+	//记录本周期的网络值，并与 Period 个周期之前比较
+	bool Settled() {
+		size_t n = nets.size();
+		uint8_t* slot = history.data() + (stats.Executed % Period) * n;
+		bool same = filled >= Period;
+		for (size_t i = 0; i < n; i++) {
+			const Bit* bit = nets[i];
+			uint8_t v = bit->isHighZ() ? 2 : uint8_t(bit->isOne());
+			same &= slot[i] == v;
+			slot[i] = v;
+		}
+		filled++;
+		return same;
+	}
+
+	//静止时阻塞，返回 false 表示线路再也不会变化或已经停止
+	bool WaitForActivity() {
+		if (sources.empty() && WakeInterval.count() == 0) return false;
+		Clock::time_point begin = Clock::now();
+		while (!stopping) {
+			uint64_t seen = InputSignal::Serial();
+			if (AnyPendingInput()) break;
+			std::chrono::milliseconds timeout = PollInterval;
+			if (WakeInterval.count() > 0) {
+				auto left = std::chrono::duration_cast<std::chrono::milliseconds>(begin + WakeInterval - Clock::now());
+				if (left.count() <= 0) break;
+				timeout = std::min(timeout, left);
+			}
+			InputSignal::Wait(seen, timeout);
+		}
+		Clock::duration waited = Clock::now() - begin;
+		idle += waited;
+		if (hz > 0) stats.Skipped += uint64_t(std::chrono::duration<double>(waited).count() * hz);
+		stats.Wakeups++;
+		filled = 0;
+		return !stopping;
+	}
+
+public:
+	//hz 为目标周期频率，0 表示不限速（静止检测仍然生效）
+	explicit RealTimeRunner(circuit& c, double hz = 0, size_t period = 2) : Period(period), target(c), hz(hz) {
+		if (period == 0) throw std::out_of_range("Period must be at least 1");
+		c.Prepare();
+		std::unordered_set<const Bit*> seen;
+		Visit(c, seen);
+		history.assign(Period * nets.size(), 0);
+	}
+
+	RealTimeRunner(const RealTimeRunner&) = delete;
+	RealTimeRunner& operator=(const RealTimeRunner&) = delete;
+
+	//从其他线程调用，Run() 在当前周期结束后返回
+	void Stop() {
+		stopping = true;
+		InputSignal::Notify();
+	}
+
+	//运行最多 maxCycles 个周期；调用 Stop()，或线路静止且没有输入源时返回
+	const Stats& Run(size_t maxCycles = SIZE_MAX) {
+		stopping = false;
+		filled = 0;
+		Clock::time_point start = Clock::now();
+		Clock::time_point origin = start;//节拍起点，唤醒或放弃追赶后重新对齐
+		uint64_t paced = 0;
+		const std::chrono::duration<double> tick(hz > 0 ? 1.0 / hz : 0.0);
+		for (size_t i = 0; i < maxCycles && !stopping; i++) {
+			if (hz > 0) {
+				Clock::time_point due = origin + std::chrono::duration_cast<Clock::duration>(tick * double(paced));
+				Clock::time_point now = Clock::now();
+				//不足1毫秒的提前量不睡眠，系统定时器的精度不够，靠后面的周期追平
+				if (due - now > std::chrono::milliseconds(1)) std::this_thread::sleep_until(due);
+				else if (now - due > MaxLag) {
+					stats.Overruns++;
+					origin = now;
+					paced = 0;
+				}
+			}
+			target.Excute();
+			stats.Executed++;
+			paced++;
+			if (Settled() && !AnyPendingInput()) {
+				if (!WaitForActivity()) break;
+				origin = Clock::now();
+				paced = 0;
+			}
+		}
+		wall += Clock::now() - start;
+		return Report();
+	}
+
+	const Stats& Report() {
+		double wallSeconds = std::chrono::duration<double>(wall).count();
+		double idleSeconds = std::chrono::duration<double>(idle).count();
+		stats.TargetHz = hz;
+		stats.WallSeconds = wallSeconds;
+		stats.IdleSeconds = idleSeconds;
+		stats.AchievedHz = wallSeconds > 0 ? double(stats.Executed + stats.Skipped) / wallSeconds : 0;
+		stats.BusyHz = wallSeconds > idleSeconds ? double(stats.Executed) / (wallSeconds - idleSeconds) : 0;
+		return stats;
+	}
+
+	void Print() {
+		const Stats& s = Report();
+		if (s.TargetHz > 0) {
+			std::print("Target {:.0f} Hz, achieved {:.0f} Hz ({:.1f}%)\n", s.TargetHz, s.AchievedHz, 100.0 * s.AchievedHz / s.TargetHz);
+		}
+		else {
+			std::print("Unpaced, achieved {:.0f} Hz\n", s.AchievedHz);
+		}
+		std::print("  executed {} cycles, skipped {} while quiescent, {} wakeups, {} overruns\n",
+			s.Executed, s.Skipped, s.Wakeups, s.Overruns);
+		std::print("  wall {:.3f} s, idle {:.3f} s, busy rate {:.0f} Hz\n", s.WallSeconds, s.IdleSeconds, s.BusyHz);
+	}
+};
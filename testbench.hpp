@@ -0,0 +1,260 @@
+#pragma once
+
+#include"elec.hpp"
+#include<coroutine>
+#include<exception>
+#include<map>
+#include<utility>
+
+//协程测试平台：激励和检查写成协程，在时钟沿、网络条件或若干周期后恢复
+//	TestTask Check(const Bit* clk, const Bit* q) {
+//		co_await Rising(clk);
+//		co_await Until(q, 1);
+//		co_await Cycles(3);
+//	}
+//	tb.Spawn(Check(clk, q));
+//	tb.Run(1000);
+//挂起的协程按触发条件登记，每个周期只检查被等待的网络和到期的定时器，与协程数量基本无关；全部在调用线程上执行
+class Testbench;
+
+class TestTask {
+public:
+	struct promise_type {
+		Testbench* bench = nullptr;
+		std::exception_ptr error;
+
+		TestTask get_return_object() { return TestTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }//由 Spawn 启动
+		std::suspend_always final_suspend() noexcept { return {}; }//由测试平台回收
+		void return_void() {}
+		void unhandled_exception() { error = std::current_exception(); }
+	};
+	using Handle = std::coroutine_handle<promise_type>;
+
+	TestTask(TestTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+	TestTask(const TestTask&) = delete;
+	TestTask& operator=(const TestTask&) = delete;
+	~TestTask() {
+		if (handle) handle.destroy();
+	}
+
+	Handle Release() { return std::exchange(handle, nullptr); }
+
+private:
+	Handle handle;
+	explicit TestTask(Handle h) : handle(h) {}
+};
+
+class Testbench {
+	friend struct Rising;
+	friend struct Falling;
+	friend struct Until;
+	friend struct Cycles;
+public:
+	//网络值：0/1，-1表示高阻
+	static int Value(const Bit* bit) {
+		return bit->isHighZ() ? -1 : int(bit->isOne());
+	}
+
+private:
+	using Handle = TestTask::Handle;
+
+	struct Edges {
+		int last;
+		std::vector<Handle> rising;
+		std::vector<Handle> falling;
+	};
+
+	struct Level {
+		int value;
+		Handle handle;
+	};
+
+	struct Timer {
+		size_t when;
+		size_t order;   //同一周期按登记顺序恢复
+		Handle handle;
+		bool operator>(const Timer& other) const {
+			return when != other.when ? when > other.when : order > other.order;
+		}
+	};
+
+	circuit& target;
+	size_t now = 0;
+	size_t timerOrder = 0;
+	std::unordered_set<void*> tasks;//未结束的协程
+	std::map<const Bit*, Edges> edges;                                 //被等待过沿的网络，记住上个周期的值
+	std::unordered_map<const Bit*, std::vector<Level>> levels;         //等待网络等于某个值
+	std::vector<std::pair<std::function<bool()>, Handle>> predicates;  //任意条件，每个周期求值
+	std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+	std::vector<Handle> ready;
+	std::exception_ptr failure;
+
+	void WaitEdge(const Bit* bit, bool risingEdge, Handle h) {
+		auto it = edges.find(bit);
+		if (it == edges.end()) it = edges.emplace(bit, Edges{ Value(bit), {}, {} }).first;
+		(risingEdge ? it->second.rising : it->second.falling).push_back(h);
+	}
+
+	void WaitLevel(const Bit* bit, int value, Handle h) { levels[bit].push_back({ value, h }); }
+
+	void WaitPredicate(std::function<bool()> condition, Handle h) { predicates.emplace_back(std::move(condition), h); }
+
+	void WaitCycles(size_t count, Handle h) { timers.push({ now + count, timerOrder++, h }); }
+
+	void Resume(Handle h) {
+		h.resume();
+		if (h.done()) {
+			if (h.promise().error && !failure) failure = h.promise().error;
+			tasks.erase(h.address());
+			h.destroy();
+		}
+	}
+
+	//一个周期结束后收集触发的协程再统一恢复，恢复中新登记的等待从下个周期开始生效
+	void Dispatch() {
+		while (!timers.empty() && timers.top().when <= now) {
+			ready.push_back(timers.top().handle);
+			timers.pop();
+		}
+		for (auto& [bit, e] : edges) {
+			int v = Value(bit);
+			if (e.last != 1 && v == 1) {
+				ready.insert(ready.end(), e.rising.begin(), e.rising.end());
+				e.rising.clear();
+			}
+			if (e.last == 1 && v != 1) {
+				ready.insert(ready.end(), e.falling.begin(), e.falling.end());
+				e.falling.clear();
+			}
+			e.last = v;
+		}
+		for (auto it = levels.begin(); it != levels.end();) {
+			int v = Value(it->first);
+			std::vector<Level>& waiting = it->second;
+			size_t kept = 0;
+			for (Level& l : waiting) {
+				if (l.value == v) ready.push_back(l.handle);
+				else waiting[kept++] = l;
+			}
+			waiting.resize(kept);
+			it = waiting.empty() ? levels.erase(it) : std::next(it);
+		}
+		if (!predicates.empty()) {
+			size_t kept = 0;
+			for (auto& p : predicates) {
+				if (p.first()) ready.push_back(p.second);
+				else predicates[kept++] = std::move(p);
+			}
+			predicates.resize(kept);
+		}
+		std::vector<Handle> batch;
+		batch.swap(ready);
+		for (Handle h : batch) Resume(h);
+	}
+
+	void Rethrow() {
+		if (failure) {
+			std::exception_ptr e = std::exchange(failure, nullptr);
+			std::rethrow_exception(e);
+		}
+	}
+
+public:
+	explicit Testbench(circuit& c) : target(c) {
+		c.Prepare();
+	}
+
+	~Testbench() {
+		for (void* address : tasks) Handle::from_address(address).destroy();
+	}
+
+	Testbench(const Testbench&) = delete;
+	Testbench& operator=(const Testbench&) = delete;
+
+	//启动一个协程，执行到第一个 co_await 为止
+	void Spawn(TestTask task) {
+		Handle h = task.Release();
+		h.promise().bench = this;
+		tasks.insert(h.address());
+		Resume(h);
+		Rethrow();
+	}
+
+	size_t Now() const { return now; }
+	size_t Pending() const { return tasks.size(); }
+
+	//执行直到所有协程结束或达到 maxCycles 个周期，返回本次执行的周期数
+	//协程中抛出的异常（检查失败）在这里重新抛出
+	size_t Run(size_t maxCycles = SIZE_MAX) {
+		size_t executed = 0;
+		while (!tasks.empty() && executed < maxCycles) {
+			target.Excute();
+			now++;
+			executed++;
+			Dispatch();
+			Rethrow();
+		}
+		return executed;
+	}
+};
+
+//等待网络的上升沿（上个周期不为1，本周期为1）
+struct Rising {
+	const Bit* bit;
+	explicit Rising(const Bit* net) : bit(net) {}
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(TestTask::Handle h) { h.promise().bench->WaitEdge(bit, true, h); }
+	void await_resume() const noexcept {}
+};
+
+//等待网络的下降沿
+struct Falling {
+	const Bit* bit;
+	explicit Falling(const Bit* net) : bit(net) {}
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(TestTask::Handle h) { h.promise().bench->WaitEdge(bit, false, h); }
+	void await_resume() const noexcept {}
+};
+
+//等待网络等于 value（-1 表示高阻）或任意条件成立；已经成立时不挂起
+struct Until {
+	const Bit* bit = nullptr;
+	int value = 0;
+	std::function<bool()> condition;
+	Until(const Bit* net, int v) : bit(net), value(v) {}
+	explicit Until(std::function<bool()> predicate) : condition(std::move(predicate)) {}
+	bool await_ready() const { return bit ? Testbench::Value(bit) == value : condition(); }
+	void await_suspend(TestTask::Handle h) {
+		if (bit) h.promise().bench->WaitLevel(bit, value, h);
+		else h.promise().bench->WaitPredicate(std::move(condition), h);
+	}
+	void await_resume() const noexcept {}
+};
+
+//等待 n 个周期
+struct Cycles {
+	size_t count;
+	explicit Cycles(size_t n) : count(n) {}
+	bool await_ready() const noexcept { return count == 0; }
+	void await_suspend(TestTask::Handle h) { h.promise().bench->WaitCycles(count, h); }
+	void await_resume() const noexcept {}
+};
+
+//测试激励：输出保持协程最后设置的值，下个周期生效
+class TestDriver : public Unit {
+public:
+	explicit TestDriver(int n) : Unit(0, n) {}
+
+	//value 为 -1 表示高阻
+	void Set(size_t index, int value) {
+		if (value == -1) Output(index) = -1;
+		else Output(index) = Bit(value != 0);
+	}
+
+	void SetWord(size_t first, size_t width, uint64_t value) {
+		for (size_t i = 0; i < width; i++) Set(first + i, int((value >> i) & 1));
+	}
+
+	void Do() override {}
+};
@@ -0,0 +1,370 @@
+#pragma once
+
+#include"netlist.hpp"
+
+//带延时的事件驱动模拟：与零延时的 circuit::Excute() 并列的另一种运行方式
+//每个门按类型取默认传输延时，可以按单元实例覆盖；事件由分层时间轮调度，插入和推进都是 O(1)
+//惯性延时：门的输出在生效前又被重新计算成别的值时，原事件被取消，短于门延时的脉冲被滤掉
+//网络值：0、1、2（高阻），读取时只看是否为1
+class TimingSimulator {
+private:
+	struct Event {
+		uint64_t time;
+		uint32_t gate;
+		uint32_t serial;//与门当前的序号不一致时表示已被取消
+		uint8_t value;
+	};
+
+	static constexpr unsigned WheelBits = 8;
+	static constexpr unsigned WheelLevels = 4;
+	static constexpr uint64_t WheelSize = uint64_t(1) << WheelBits;
+	static constexpr uint64_t WheelMask = WheelSize - 1;
+
+	Netlist net;
+	std::vector<uint32_t> delay;     //每个门的延时
+	std::vector<uint32_t> serial;
+	std::vector<uint8_t> pending;    //门是否有尚未生效的事件
+	std::vector<uint8_t> pendingValue;
+	std::vector<uint8_t> value;      //网络值
+	std::vector<uint8_t> q;          //Dff/Latch 状态
+	std::vector<uint8_t> last;       //Dff 上次的时钟
+	std::vector<uint64_t> transitions;//每个网络的翻转次数
+	std::vector<uint32_t> fanoutFirst;//网络 -> 读取它的门（CSR）
+	std::vector<uint32_t> fanout;
+	std::vector<uint64_t> stamp;     //门在本时刻是否已加入待计算列表
+	std::vector<uint32_t> dirty;
+	uint64_t round = 0;
+	std::unordered_map<const Bit*, uint32_t> netIndex;
+
+	//分层时间轮：第 k 层每格代表 256^k 个时间单位，超出范围的事件放入 overflow
+	std::vector<Event> wheel[WheelLevels][WheelSize];
+	size_t levelCount[WheelLevels] = {};
+	std::vector<Event> overflow;
+	std::vector<Event> current;
+	uint64_t now = 0;
+	size_t scheduled = 0;
+
+	uint64_t events = 0;
+	uint64_t cancelled = 0;
+	uint64_t evaluations = 0;
+	uint64_t lastChange = 0;
+
+	void Insert(const Event& e) {
+		for (unsigned k = 0; k < WheelLevels; k++) {
+			unsigned shift = WheelBits * (k + 1);
+			if ((e.time >> shift) == (now >> shift)) {
+				wheel[k][(e.time >> (WheelBits * k)) & WheelMask].push_back(e);
+				levelCount[k]++;
+				scheduled++;
+				return;
+			}
+		}
+		overflow.push_back(e);
+		scheduled++;
+	}
+
+	//now 跨过高层格子的边界时，把该格的事件重新分配到低层（先高层后低层）
+	void Cascade() {
+		unsigned top = 0;
+		while (top + 1 <= WheelLevels && (now & ((uint64_t(1) << (WheelBits * (top + 1))) - 1)) == 0) top++;
+		if (top == WheelLevels) {
+			std::vector<Event> far;
+			far.swap(overflow);
+			scheduled -= far.size();
+			for (const Event& e : far) Insert(e);
+			top = WheelLevels - 1;
+		}
+		for (unsigned k = top; k >= 1; k--) {
+			std::vector<Event>& slot = wheel[k][(now >> (WheelBits * k)) & WheelMask];
+			if (slot.empty()) continue;
+			current.swap(slot);
+			levelCount[k] -= current.size();
+			scheduled -= current.size();
+			for (const Event& e : current) Insert(e);
+			current.clear();
+		}
+	}
+
+	void MarkFanout(uint32_t n) {
+		for (uint32_t i = fanoutFirst[n]; i < fanoutFirst[n + 1]; i++) {
+			uint32_t g = fanout[i];
+			if (stamp[g] != round) {
+				stamp[g] = round;
+				dirty.push_back(g);
+			}
+		}
+	}
+
+	uint8_t Evaluate(uint32_t index) {
+		const Netlist::Gate& g = net.Gates[index];
+		uint8_t a = value[g.in[0]] == 1, b = value[g.in[1]] == 1;
+		switch (g.op) {
+		case Netlist::Op::And: return a & b;
+		case Netlist::Op::Or:
+		case Netlist::Op::Resolve: return a | b;
+		case Netlist::Op::Xor: return a ^ b;
+		case Netlist::Op::Not: return !a;
+		case Netlist::Op::Buf: return a;
+		case Netlist::Op::Const1: return 1;
+		case Netlist::Op::Tri: return b ? a : uint8_t(2);
+		case Netlist::Op::Dec3: return (a | (b << 1) | ((value[g.in[2]] == 1) << 2)) == g.aux;
+		case Netlist::Op::Latch:
+			if (a) q[g.in[2]] = b;
+			return q[g.in[2]];
+		case Netlist::Op::Dff:
+			if (!last[g.in[2]] && b) q[g.in[2]] = a;
+			last[g.in[2]] = b;
+			return q[g.in[2]];
+		case Netlist::Op::Lut: {
+			const Netlist::Lut& lut = net.Luts[g.in[0]];
+			unsigned m = 0;
+			for (unsigned k = 0; k < lut.count; k++) m |= unsigned(value[lut.in[k]] == 1) << k;
+			return uint8_t((lut.table >> m) & 1);
+		}
+		default: return 0;
+		}
+	}
+
+	//重新计算一个门并按惯性延时安排输出
+	void Schedule(uint32_t index) {
+		evaluations++;
+		uint8_t v = Evaluate(index);
+		uint32_t out = net.Gates[index].out;
+		if (pending[index]) {
+			if (pendingValue[index] == v) return;
+			serial[index]++;
+			pending[index] = 0;
+			cancelled++;
+		}
+		if (v == value[out]) return;
+		pending[index] = 1;
+		pendingValue[index] = v;
+		Insert({ now + delay[index], index, serial[index], v });
+	}
+
+	//处理当前时刻的全部事件，零延时的门在同一时刻内继续传播
+	void Settle() {
+		for (;;) {
+			std::vector<Event>& slot = wheel[0][now & WheelMask];
+			if (slot.empty() && dirty.empty()) return;
+			current.swap(slot);
+			levelCount[0] -= current.size();
+			scheduled -= current.size();
+			round++;
+			for (uint32_t g : dirty) stamp[g] = round;
+			for (const Event& e : current) {
+				if (e.serial != serial[e.gate]) continue;
+				pending[e.gate] = 0;
+				uint32_t out = net.Gates[e.gate].out;
+				if (value[out] == e.value) continue;
+				value[out] = e.value;
+				transitions[out]++;
+				events++;
+				lastChange = now;
+				MarkFanout(out);
+			}
+			current.clear();
+			std::vector<uint32_t> work;
+			work.swap(dirty);
+			for (uint32_t g : work) Schedule(g);
+		}
+	}
+
+	void Build() {
+		for (const Netlist::Gate& g : net.Gates) {
+			if (g.op == Netlist::Op::Opaque) {
+				throw std::runtime_error("Timing simulation does not support behavioral unit");
+			}
+		}
+		//线或解析门在零延时网表中会重复生成，事件模式下只保留一份
+		std::vector<Netlist::Gate> gates;
+		std::vector<bool> resolved(net.NetCount(), false);
+		for (const Netlist::Gate& g : net.Gates) {
+			if (g.op == Netlist::Op::Resolve) {
+				if (resolved[g.out]) continue;
+				resolved[g.out] = true;
+			}
+			gates.push_back(g);
+		}
+		net.Gates = std::move(gates);
+
+		const size_t gateCount = net.Gates.size();
+		const size_t netCount = net.NetCount();
+		delay.resize(gateCount);
+		for (size_t i = 0; i < gateCount; i++) delay[i] = DefaultDelay(net.Gates[i]);
+		serial.assign(gateCount, 0);
+		pending.assign(gateCount, 0);
+		pendingValue.assign(gateCount, 0);
+		stamp.assign(gateCount, 0);
+		value.resize(netCount);
+		for (uint32_t n = 0; n < netCount; n++) {
+			Bit* bit = net.NetBits[n];
+			if (bit) netIndex.emplace(bit, n);
+			value[n] = !bit ? 0 : (bit->isHighZ() ? 2 : (bit->isOne() ? 1 : 0));
+		}
+		q.assign(net.StateCount, 0);
+		last.assign(net.StateCount, 0);
+		for (const Netlist::Gate& g : net.Gates) {
+			if (g.op == Netlist::Op::Dff || g.op == Netlist::Op::Latch) {
+				q[g.in[2]] = value[g.out] == 1;
+				if (g.op == Netlist::Op::Dff) last[g.in[2]] = value[g.in[1]] == 1;
+			}
+		}
+		transitions.assign(netCount, 0);
+
+		fanoutFirst.assign(netCount + 1, 0);
+		auto forEachInput = [&](const Netlist::Gate& g, auto&& f) {
+			if (g.op == Netlist::Op::Lut) {
+				const Netlist::Lut& lut = net.Luts[g.in[0]];
+				for (unsigned k = 0; k < lut.count; k++) f(lut.in[k]);
+			}
+			else {
+				size_t arity = Netlist::Arity(g.op);
+				for (size_t k = 0; k < arity; k++) {
+					//同一个网络接在门的多个输入上时只记一次
+					bool repeated = false;
+					for (size_t j = 0; j < k; j++) repeated |= g.in[j] == g.in[k];
+					if (!repeated) f(g.in[k]);
+				}
+			}
+		};
+		for (const Netlist::Gate& g : net.Gates) {
+			forEachInput(g, [&](uint32_t n) { fanoutFirst[n + 1]++; });
+		}
+		for (size_t n = 0; n < netCount; n++) fanoutFirst[n + 1] += fanoutFirst[n];
+		fanout.resize(fanoutFirst[netCount]);
+		std::vector<uint32_t> fill(fanoutFirst.begin(), fanoutFirst.end() - 1);
+		for (uint32_t i = 0; i < gateCount; i++) {
+			forEachInput(net.Gates[i], [&](uint32_t n) { fanout[fill[n]++] = i; });
+		}
+
+		//开始时所有门都计算一次
+		round++;
+		for (uint32_t i = 0; i < gateCount; i++) {
+			stamp[i] = round;
+			dirty.push_back(i);
+		}
+	}
+
+public:
+	//默认传输延时，单位为模拟时间单位
+	//线或解析和总线缓冲视为导线，没有延时；时钟单元的延时是半个周期
+	static uint32_t DefaultDelay(Netlist::Op op) {
+		switch (op) {
+		case Netlist::Op::Not: return 1;
+		case Netlist::Op::And:
+		case Netlist::Op::Or: return 2;
+		case Netlist::Op::Xor: return 3;
+		case Netlist::Op::Tri: return 1;
+		case Netlist::Op::Dec3: return 2;
+		case Netlist::Op::Latch:
+		case Netlist::Op::Dff: return 2;
+		case Netlist::Op::Lut: return 2;
+		default: return 0;
+		}
+	}
+
+	static constexpr uint32_t ClockHalfPeriod = 100;
+
+	static uint32_t DefaultDelay(const Netlist::Gate& g) {
+		//时钟展开为输出接回输入的非门
+		if (g.op == Netlist::Op::Not && g.in[0] == g.out) return ClockHalfPeriod;
+		return DefaultDelay(g.op);
+	}
+
+	explicit TimingSimulator(circuit& c) : net(c) { Build(); }
+
+	//单元的输入输出作为边界，由 Set() 驱动输入
+	explicit TimingSimulator(Unit* root) : net(root) { Build(); }
+
+	const Netlist& Net() const { return net; }
+
+	//修改某类门的延时（已按实例覆盖的门也会被改写）
+	void SetDelay(Netlist::Op op, uint32_t d) {
+		for (size_t i = 0; i < net.Gates.size(); i++) {
+			if (net.Gates[i].op == op) delay[i] = d;
+		}
+	}
+
+	//覆盖某个单元实例展开出的全部门的延时
+	void SetDelay(Unit* instance, uint32_t d) {
+		bool found = false;
+		for (size_t i = 0; i < net.Gates.size(); i++) {
+			if (net.Gates[i].unit == instance) {
+				delay[i] = d;
+				found = true;
+			}
+		}
+		if (!found) throw std::runtime_error("Unit is not part of the timing netlist");
+	}
+
+	uint32_t NetOf(const Bit* bit) const {
+		auto it = netIndex.find(bit);
+		if (it == netIndex.end()) throw std::runtime_error("Bit is not part of the timing netlist");
+		return it->second;
+	}
+
+	//在当前时刻改变一个网络（通常是输入），value 为 -1 表示高阻
+	void Set(uint32_t n, int v) {
+		uint8_t next = v == -1 ? 2 : uint8_t(v != 0);
+		if (value[n] == next) return;
+		value[n] = next;
+		transitions[n]++;
+		lastChange = now;
+		if (dirty.empty()) round++;
+		MarkFanout(n);
+	}
+
+	//网络值：0/1，-1表示高阻
+	int Value(uint32_t n) const {
+		return value[n] == 2 ? -1 : value[n];
+	}
+
+	//推进 duration 个时间单位（包括当前时刻的事件），返回当前时间
+	uint64_t Run(uint64_t duration) {
+		uint64_t limit = now + duration;
+		for (;;) {
+			Settle();
+			if (now >= limit) break;
+			if (scheduled == 0) {
+				now = limit;
+				break;
+			}
+			if (levelCount[0] == 0) {
+				//跳到下一个有事件的层的格子边界
+				unsigned k = 1;
+				while (k < WheelLevels && levelCount[k] == 0) k++;
+				unsigned shift = WheelBits * (k < WheelLevels ? k : WheelLevels);
+				uint64_t next = ((now >> shift) + 1) << shift;
+				if (next > limit) {
+					now = limit;
+					break;
+				}
+				now = next;
+			}
+			else {
+				now++;
+			}
+			if ((now & WheelMask) == 0) Cascade();
+		}
+		return now;
+	}
+
+	//运行到没有待处理的事件为止，返回最后一次网络变化的时间
+	//maxTime 内没有稳定（例如有时钟）时抛出异常
+	uint64_t RunUntilStable(uint64_t maxTime = 1000000) {
+		uint64_t limit = now + maxTime;
+		while (scheduled > 0 || !dirty.empty()) {
+			if (now >= limit) throw std::runtime_error("Circuit did not settle");
+			Run(1);
+		}
+		return lastChange;
+	}
+
+	uint64_t Now() const { return now; }
+	uint64_t Events() const { return events; }        //生效的网络变化次数
+	uint64_t Cancelled() const { return cancelled; }  //被惯性延时取消的事件
+	uint64_t Evaluations() const { return evaluations; }
+	uint64_t Transitions(uint32_t n) const { return transitions[n]; }
+	uint64_t LastChange() const { return lastChange; }
+};